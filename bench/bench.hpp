@@ -0,0 +1,147 @@
+#ifndef DAMOGRAN_BENCH_HPP_
+#define DAMOGRAN_BENCH_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace damogran {
+namespace bench {
+
+// keeps the compiler from discarding benchmarked results
+template <typename T>
+inline void do_not_optimize(const T& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct result {
+	std::string name;
+	std::size_t items;       // items processed per iteration
+	uint64_t    iterations;
+	double      seconds;
+
+	double items_per_second() const { return static_cast<double>(items) * iterations / seconds; }
+	double ns_per_item() const { return seconds * 1e9 / (static_cast<double>(items) * iterations); }
+};
+
+// untimed statistic reported next to the timings, passing if value <= limit
+struct metric {
+	std::string name;
+	double      value;
+	double      limit;
+
+	bool pass() const { return value <= limit; }
+};
+
+// Minimal google-benchmark like runner. Every benchmark is repeated until
+// it ran for at least --min_time seconds; results (and metrics recorded via
+// record()) are printed as CSV or JSON (--format=csv|json, default json) to
+// stdout once run() calls are done. --filter=<substring> restricts the
+// benchmarks that are run and the metrics that are recorded.
+class runner {
+	public:
+		runner(int argc, char** argv) : min_time_(0.2), json_(true) {
+			for (int i = 1; i < argc; ++i) {
+				std::string arg(argv[i]);
+				if (arg.compare(0, 11, "--min_time=") == 0) {
+					min_time_ = std::atof(arg.c_str() + 11);
+				} else if (arg == "--format=csv") {
+					json_ = false;
+				} else if (arg == "--format=json") {
+					json_ = true;
+				} else if (arg.compare(0, 9, "--filter=") == 0) {
+					filter_ = arg.substr(9);
+				} else {
+					std::cerr << "usage: " << argv[0] << " [--min_time=<seconds>] [--format=csv|json] [--filter=<substring>]\n";
+					std::exit(1);
+				}
+			}
+		}
+
+		~runner() {
+			report();
+		}
+
+		bool enabled(const std::string& name) const {
+			return filter_.empty() || name.find(filter_) != std::string::npos;
+		}
+
+		template <typename Func>
+		void run(const std::string& name, std::size_t items, Func&& func) {
+			if (!enabled(name)) return;
+			typedef std::chrono::steady_clock clock_t;
+			func(); // warm up caches and lazily built tables
+			uint64_t iterations = 1;
+			for (;;) {
+				auto start = clock_t::now();
+				for (uint64_t i = 0; i < iterations; ++i) {
+					func();
+				}
+				double seconds = std::chrono::duration<double>(clock_t::now() - start).count();
+				if (seconds >= min_time_ || iterations >= (uint64_t(1) << 40)) {
+					results_.push_back(result{name, items, iterations, seconds});
+					std::cerr << name << ": " << results_.back().items_per_second() << " items/s\n";
+					return;
+				}
+				double factor = seconds > 0.0 ? 1.4 * min_time_ / seconds : 10.0;
+				iterations = static_cast<uint64_t>(iterations * std::min(std::max(factor, 2.0), 100.0));
+			}
+		}
+
+		void record(const std::string& name, double value, double limit) {
+			if (!enabled(name)) return;
+			metrics_.push_back(metric{name, value, limit});
+			std::cerr << name << ": " << value << " (limit " << limit << ")" << (metrics_.back().pass() ? "" : " FAILED") << "\n";
+		}
+
+	protected:
+		void report() const {
+			if (json_) {
+				std::printf("{\n  \"benchmarks\": [\n");
+				for (std::size_t i = 0; i < results_.size(); ++i) {
+					const result& r = results_[i];
+					std::printf("    {\"name\": \"%s\", \"items\": %zu, \"iterations\": %llu, \"seconds\": %.6f, \"items_per_second\": %.6e, \"ns_per_item\": %.4f}%s\n",
+						r.name.c_str(), r.items, static_cast<unsigned long long>(r.iterations), r.seconds, r.items_per_second(), r.ns_per_item(), i + 1 < results_.size() ? "," : "");
+				}
+				std::printf("  ]");
+				if (!metrics_.empty()) {
+					std::printf(",\n  \"metrics\": [\n");
+					for (std::size_t i = 0; i < metrics_.size(); ++i) {
+						const metric& m = metrics_[i];
+						std::printf("    {\"name\": \"%s\", \"value\": %.6e, \"limit\": %.6e, \"pass\": %s}%s\n",
+							m.name.c_str(), m.value, m.limit, m.pass() ? "true" : "false", i + 1 < metrics_.size() ? "," : "");
+					}
+					std::printf("  ]");
+				}
+				std::printf("\n}\n");
+			} else {
+				std::printf("name,items,iterations,seconds,items_per_second,ns_per_item\n");
+				for (const result& r : results_) {
+					std::printf("\"%s\",%zu,%llu,%.6f,%.6e,%.4f\n", r.name.c_str(), r.items, static_cast<unsigned long long>(r.iterations), r.seconds, r.items_per_second(), r.ns_per_item());
+				}
+				if (!metrics_.empty()) {
+					std::printf("\nmetric,value,limit,pass\n");
+					for (const metric& m : metrics_) {
+						std::printf("\"%s\",%.6e,%.6e,%d\n", m.name.c_str(), m.value, m.limit, m.pass() ? 1 : 0);
+					}
+				}
+			}
+		}
+
+	protected:
+		double              min_time_;
+		bool                json_;
+		std::string         filter_;
+		std::vector<result> results_;
+		std::vector<metric> metrics_;
+};
+
+
+} // bench
+} // damogran
+
+#endif /* DAMOGRAN_BENCH_HPP_ */
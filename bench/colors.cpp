@@ -0,0 +1,134 @@
+#include "bench.hpp"
+
+#include <colors.hpp>
+#include <macros.hpp>
+
+using namespace damogran;
+
+namespace {
+
+constexpr std::size_t batch_size = 1 << 16;
+constexpr uint64_t seed = 42;
+
+template <class ColorType>
+std::vector<ColorType> input_colors() {
+	std::vector<ColorType> colors(batch_size);
+	generate<ColorType>::random_hues(span<ColorType>(colors), seed);
+	return colors;
+}
+
+template <class TargetType, class SourceType>
+void bench_conversion(bench::runner& runner, const std::string& name) {
+	// skips generating inputs for filtered out benchmarks
+	if (!runner.enabled("convert/" + name + "/ctor") && !runner.enabled("convert/" + name + "/batch")) return;
+	std::vector<SourceType> input = input_colors<SourceType>();
+	std::vector<TargetType> output(batch_size);
+	runner.run("convert/" + name + "/ctor", batch_size, [&] () {
+		for (std::size_t i = 0; i < batch_size; ++i) {
+			output[i] = TargetType(input[i]);
+		}
+		bench::do_not_optimize(output.data());
+	});
+	runner.run("convert/" + name + "/batch", batch_size, [&] () {
+		convert<TargetType>(span<const SourceType>(input), span<TargetType>(output));
+		bench::do_not_optimize(output.data());
+	});
+}
+
+template <class TargetType, class SourceType>
+void bench_integer_conversion(bench::runner& runner, const std::string& name, bool lut) {
+	if (!runner.enabled("convert/" + name + "/fixed") && !(lut && runner.enabled("convert/" + name + "/lut"))) return;
+	std::vector<SourceType> input = input_colors<SourceType>();
+	std::vector<TargetType> output(batch_size);
+	runner.run("convert/" + name + "/fixed", batch_size, [&] () {
+		convert_fixed<TargetType>(span<const SourceType>(input), span<TargetType>(output));
+		bench::do_not_optimize(output.data());
+	});
+	if (!lut) return;
+	runner.run("convert/" + name + "/lut", batch_size, [&] () {
+		convert_lut<TargetType>(span<const SourceType>(input), span<TargetType>(output));
+		bench::do_not_optimize(output.data());
+	});
+}
+
+template <class ColorType>
+void bench_generate(bench::runner& runner, const std::string& name) {
+	typedef typename ColorType::scalar_type scalar_type;
+	for (std::size_t count : {1000, 100000, 1000000}) {
+		std::string suffix = "/" + std::to_string(count);
+		std::vector<ColorType> output(count);
+		runner.run("generate/" + name + "/random_hues" + suffix, count, [&] () {
+			generate<ColorType>::random_hues(span<ColorType>(output), seed);
+			bench::do_not_optimize(output.data());
+		});
+		runner.run("generate/" + name + "/random_hues_1t" + suffix, count, [&] () {
+			generate<ColorType>::random_hues(span<ColorType>(output), seed, scalar_type(1), scalar_type(1), scalar_type(1), 1);
+			bench::do_not_optimize(output.data());
+		});
+		auto full = std::make_pair(scalar_type(0), scalar_type(1));
+		runner.run("generate/" + name + "/uniform" + suffix, count, [&] () {
+			generate<ColorType>::uniform(span<ColorType>(output), full, full, full);
+			bench::do_not_optimize(output.data());
+		});
+		runner.run("generate/" + name + "/uniform_1t" + suffix, count, [&] () {
+			generate<ColorType>::uniform(span<ColorType>(output), full, full, full, scalar_type(1), 1);
+			bench::do_not_optimize(output.data());
+		});
+	}
+}
+
+} // anonymous
+
+// all source/target pairs of a scalar type
+#define COLOR_PAIRS(type) \
+	PAIR(RGB, RGB, type) \
+	PAIR(RGB, RGBA, type) \
+	PAIR(RGB, HSV, type) \
+	PAIR(RGB, HSVA, type) \
+	PAIR(RGBA, RGB, type) \
+	PAIR(RGBA, RGBA, type) \
+	PAIR(RGBA, HSV, type) \
+	PAIR(RGBA, HSVA, type) \
+	PAIR(HSV, RGB, type) \
+	PAIR(HSV, RGBA, type) \
+	PAIR(HSV, HSV, type) \
+	PAIR(HSV, HSVA, type) \
+	PAIR(HSVA, RGB, type) \
+	PAIR(HSVA, RGBA, type) \
+	PAIR(HSVA, HSV, type) \
+	PAIR(HSVA, HSVA, type)
+
+int main(int argc, char** argv) {
+	bench::runner runner(argc, argv);
+
+#define X(type) COLOR_PAIRS(type)
+#define PAIR(target, source, type) \
+	bench_conversion<target<type>, source<type>>(runner, #source "<" #type ">->" #target);
+COLOR_SCALAR_TYPES
+#undef PAIR
+#undef X
+
+#define X(type, has_lut) { \
+	const bool lut = has_lut; \
+	COLOR_PAIRS(type) \
+}
+#define PAIR(target, source, type) \
+	bench_integer_conversion<target<type>, source<type>>(runner, #source "<" #type ">->" #target, lut);
+	X(short, true)
+	X(int, false)
+	X(unsigned int, false)
+	X(char, true)
+	X(unsigned char, true)
+#undef PAIR
+#undef X
+
+#define X(type) \
+	bench_generate<RGB<type>>(runner, "RGB<" #type ">"); \
+	bench_generate<RGBA<type>>(runner, "RGBA<" #type ">"); \
+	bench_generate<HSV<type>>(runner, "HSV<" #type ">"); \
+	bench_generate<HSVA<type>>(runner, "HSVA<" #type ">");
+COLOR_SCALAR_TYPES
+#undef X
+
+	return 0;
+}
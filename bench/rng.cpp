@@ -0,0 +1,287 @@
+#include "bench.hpp"
+
+#include <cmath>
+#include <thread>
+#include <functional>
+#include <type_traits>
+
+#include <rng.hpp>
+#include <macros.hpp>
+
+using namespace damogran;
+
+namespace {
+
+constexpr std::size_t batch_size = 1 << 16;
+constexpr std::size_t threaded_size = 1 << 20;
+constexpr std::size_t sample_size = 1 << 20;
+constexpr uint64_t seed = 42;
+// |z| above this fails a moment or correlation check, p ~ 6e-5 per check
+constexpr double z_limit = 4.0;
+
+std::vector<unsigned int> thread_counts() {
+	unsigned int max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<unsigned int> counts;
+	for (unsigned int threads = 1; threads < max_threads; threads *= 2) {
+		counts.push_back(threads);
+	}
+	counts.push_back(max_threads);
+	return counts;
+}
+
+// Distribution the statistical battery compares samples against. Samples
+// are binned by bin(x) in [0, bins) with expected frequency probability(bin).
+struct reference {
+	std::size_t bins;
+	std::function<std::size_t (double)> bin;
+	std::function<double (std::size_t)> probability;
+	double mean;
+	double variance;
+};
+
+// Continuous distributions are binned by their cdf into equiprobable bins.
+reference continuous(std::function<double (double)> cdf, double mean, double variance) {
+	const std::size_t bins = 64;
+	return reference{bins, [=] (double x) { return std::min(static_cast<std::size_t>(cdf(x) * bins), bins - 1); }, [=] (std::size_t) { return 1.0 / bins; }, mean, variance};
+}
+
+// Upper quantile of the chi-square distribution with df degrees of freedom
+// at p = 1e-4 (Wilson-Hilferty approximation).
+double chi2_limit(double df) {
+	const double z = 3.719;
+	const double c = 2.0 / (9.0 * df);
+	return df * std::pow(1.0 - c + z * std::sqrt(c), 3.0);
+}
+
+// Records chi-square goodness of fit, |z| of sample mean and variance
+// against the reference and |z| of lag 1 and 4 autocorrelation (lag 4
+// matches the lane count of the bulk engine). samples() is only called if
+// one of these metrics passes the filter.
+template <class Samples>
+void battery(bench::runner& runner, const std::string& name, Samples&& samples, const reference& ref) {
+	bool wanted = false;
+	for (const char* metric : {"/chi2", "/mean_z", "/variance_z", "/lag1_z", "/lag4_z"}) {
+		wanted = wanted || runner.enabled(name + metric);
+	}
+	if (!wanted) return;
+	const std::vector<double> x = samples();
+	const double n = static_cast<double>(x.size());
+
+	std::vector<double> counts(ref.bins, 0.0);
+	for (double v : x) counts[ref.bin(v)] += 1.0;
+	double chi2 = 0.0;
+	for (std::size_t b = 0; b < ref.bins; ++b) {
+		const double expected = n * ref.probability(b);
+		chi2 += (counts[b] - expected) * (counts[b] - expected) / expected;
+	}
+	runner.record(name + "/chi2", chi2, chi2_limit(static_cast<double>(ref.bins - 1)));
+
+	double mean = 0.0;
+	for (double v : x) mean += v;
+	mean /= n;
+	double m2 = 0.0, m4 = 0.0;
+	for (double v : x) {
+		const double d = (v - mean) * (v - mean);
+		m2 += d;
+		m4 += d * d;
+	}
+	m2 /= n;
+	m4 /= n;
+	runner.record(name + "/mean_z", std::abs(mean - ref.mean) / std::sqrt(m2 / n), z_limit);
+	runner.record(name + "/variance_z", std::abs(m2 - ref.variance) / std::sqrt((m4 - m2 * m2) / n), z_limit);
+
+	for (std::size_t lag : {1, 4}) {
+		double c = 0.0;
+		for (std::size_t i = lag; i < x.size(); ++i) c += (x[i] - mean) * (x[i - lag] - mean);
+		const double r = c / (m2 * n);
+		runner.record(name + "/lag" + std::to_string(lag) + "_z", std::abs(r) * std::sqrt(n - static_cast<double>(lag)), z_limit);
+	}
+}
+
+template <class T, class Draw>
+std::vector<double> draw_samples(Draw&& draw) {
+	std::vector<double> x(sample_size);
+	for (double& v : x) v = static_cast<double>(draw());
+	return x;
+}
+
+template <class T, class Fill>
+std::vector<double> fill_samples(Fill&& fill) {
+	std::vector<T> values(sample_size);
+	fill(span<T>(values));
+	return std::vector<double>(values.begin(), values.end());
+}
+
+template <class T, class Engine>
+void bench_engine(bench::runner& runner, const std::string& name, Engine engine, std::vector<T>& output) {
+	runner.run(name, batch_size, [&] () {
+		for (std::size_t i = 0; i < batch_size; ++i) {
+			output[i] = engine();
+		}
+		bench::do_not_optimize(output.data());
+	});
+}
+
+// Benchmarks one distribution through every interface: the scalar function
+// on the thread-local engine, the std::function generator, the inline
+// engine object over each engine type, bulk fills on the bulk and stream
+// engines and all of them again on 1..hardware_concurrency threads. Then
+// runs the statistical battery on the output of every interface.
+//   scalar()                      - one draw from the scalar function
+//   gen()                         - the *_gen generator
+//   make_engine(engine)           - the *_engine object over engine
+//   fill(engine, span<T> values)  - the fill_* function on engine
+template <class T, class Scalar, class Gen, class MakeEngine, class Fill>
+void bench_distribution(bench::runner& runner, const std::string& name, const reference& ref, Scalar&& scalar, Gen&& gen, MakeEngine&& make_engine, Fill&& fill) {
+	std::vector<T> output(batch_size);
+	runner.run(name + "/scalar", batch_size, [&] () {
+		for (std::size_t i = 0; i < batch_size; ++i) {
+			output[i] = scalar();
+		}
+		bench::do_not_optimize(output.data());
+	});
+	auto generator = gen();
+	runner.run(name + "/gen", batch_size, [&] () {
+		for (std::size_t i = 0; i < batch_size; ++i) {
+			output[i] = generator();
+		}
+		bench::do_not_optimize(output.data());
+	});
+	bench_engine(runner, name + "/engine:xoshiro256pp", make_engine(xoshiro256pp(seed)), output);
+	bench_engine(runner, name + "/engine:mt19937", make_engine(std::mt19937(seed)), output);
+	bench_engine(runner, name + "/engine:philox4x32", make_engine(philox4x32(seed)), output);
+	runner.run(name + "/fill:bulk", batch_size, [&] () {
+		fill(rng::bulk_engine(), span<T>(output));
+		bench::do_not_optimize(output.data());
+	});
+	rng::stream_generator_t stream = rng::stream(seed, 0);
+	runner.run(name + "/fill:stream", batch_size, [&] () {
+		fill(stream, span<T>(output));
+		bench::do_not_optimize(output.data());
+	});
+
+	std::vector<T> large(threaded_size);
+	for (unsigned int threads : thread_counts()) {
+		const std::string prefix = name + "/threads:" + std::to_string(threads);
+		const std::size_t chunk_size = threaded_size / threads;
+		runner.run(prefix + "/scalar", threaded_size, [&] () {
+			parallel_chunks(threaded_size, chunk_size, [&] (std::size_t, std::size_t begin, std::size_t end) {
+				for (std::size_t i = begin; i < end; ++i) {
+					large[i] = scalar();
+				}
+			}, threads);
+			bench::do_not_optimize(large.data());
+		});
+		runner.run(prefix + "/fill:bulk", threaded_size, [&] () {
+			parallel_chunks(threaded_size, chunk_size, [&] (std::size_t, std::size_t begin, std::size_t end) {
+				fill(rng::bulk_engine(), span<T>(large.data() + begin, end - begin));
+			}, threads);
+			bench::do_not_optimize(large.data());
+		});
+		runner.run(prefix + "/fill:stream", threaded_size, [&] () {
+			rng::parallel_streams(threaded_size, chunk_size, seed, [&] (rng::stream_generator_t& engine, std::size_t begin, std::size_t end) {
+				fill(engine, span<T>(large.data() + begin, end - begin));
+			}, threads);
+			bench::do_not_optimize(large.data());
+		});
+	}
+
+	const std::string quality = "quality/" + name;
+	battery(runner, quality + "/scalar", [&] () { return draw_samples<T>(scalar); }, ref);
+	battery(runner, quality + "/gen", [&] () { return draw_samples<T>(gen()); }, ref);
+	battery(runner, quality + "/engine:xoshiro256pp", [&] () { return draw_samples<T>(make_engine(xoshiro256pp(seed))); }, ref);
+	battery(runner, quality + "/engine:mt19937", [&] () { return draw_samples<T>(make_engine(std::mt19937(seed))); }, ref);
+	battery(runner, quality + "/engine:philox4x32", [&] () { return draw_samples<T>(make_engine(philox4x32(seed))); }, ref);
+	battery(runner, quality + "/fill:bulk", [&] () {
+		return fill_samples<T>([&] (span<T> values) { fill(rng::bulk_engine(), values); });
+	}, ref);
+	battery(runner, quality + "/fill:stream", [&] () {
+		return fill_samples<T>([&] (span<T> values) {
+			rng::parallel_streams(values.size(), batch_size, seed, [&] (rng::stream_generator_t& engine, std::size_t begin, std::size_t end) {
+				fill(engine, values.subspan(begin, end - begin));
+			});
+		});
+	}, ref);
+}
+
+template <class T>
+void bench_uniform_ab(bench::runner& runner, const std::string& name, std::true_type) {
+	const T a = T(-1), b = T(3);
+	reference ref = continuous([=] (double x) { return (x - a) / (b - a); }, 0.5 * (a + b), (b - a) * (b - a) / 12.0);
+	bench_distribution<T>(runner, "uniform_ab/" + name, ref,
+		[&] () { return rng::uniform_ab<T>(a, b); },
+		[&] () { return rng::uniform_ab_gen<T>(a, b); },
+		[&] (auto engine) { return rng::uniform_ab_engine<T, decltype(engine)>(a, b, engine); },
+		[&] (auto& engine, span<T> values) { rng::fill_uniform(engine, values, a, b); });
+}
+
+template <class T>
+void bench_uniform_ab(bench::runner& runner, const std::string& name, std::false_type) {
+	// 100 values fit every integral type
+	const T a = std::is_signed<T>::value ? T(-50) : T(0), b = T(a + 100);
+	reference ref{100, [=] (double x) { return static_cast<std::size_t>(x - a); }, [] (std::size_t) { return 0.01; }, 0.5 * (a + b - 1), (100.0 * 100.0 - 1.0) / 12.0};
+	bench_distribution<T>(runner, "uniform_ab/" + name, ref,
+		[&] () { return rng::uniform_ab<T>(a, b); },
+		[&] () { return rng::uniform_ab_gen<T>(a, b); },
+		[&] (auto engine) { return rng::uniform_ab_engine<T, decltype(engine)>(a, b, engine); },
+		[&] (auto& engine, span<T> values) { rng::fill_uniform(engine, values, a, b); });
+}
+
+template <class T>
+void bench_geometric(bench::runner& runner, const std::string& name) {
+	const float p = 0.25f;
+	// counts of 30 and above share the last bin
+	const std::size_t tail = 30;
+	reference ref{tail + 1,
+		[=] (double x) { return std::min(static_cast<std::size_t>(x), tail); },
+		[=] (std::size_t k) { return k < tail ? p * std::pow(1.0 - p, double(k)) : std::pow(1.0 - p, double(tail)); },
+		(1.0 - p) / p, (1.0 - p) / (p * p)};
+	bench_distribution<T>(runner, "geometric/" + name, ref,
+		[&] () { return rng::geometric<T>(p); },
+		[&] () { return rng::geometric_gen<T>(p); },
+		[&] (auto engine) { return rng::geometric_engine<T, decltype(engine)>(p, engine); },
+		[&] (auto& engine, span<T> values) { rng::fill_geometric(engine, values, p); });
+}
+
+template <class T>
+void bench_real(bench::runner& runner, const std::string& name) {
+	bench_distribution<T>(runner, "uniform_01/" + name, continuous([] (double x) { return x; }, 0.5, 1.0 / 12.0),
+		[&] () { return rng::uniform_01<T>(); },
+		[&] () { return rng::uniform_01_gen<T>(); },
+		[&] (auto engine) { return rng::uniform_01_engine<T, decltype(engine)>(engine); },
+		[&] (auto& engine, span<T> values) { rng::fill_uniform_01(engine, values); });
+	bench_distribution<T>(runner, "normal/" + name, continuous([] (double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }, 0.0, 1.0),
+		[&] () { return rng::normal<T>(); },
+		[&] () { return rng::normal_gen<T>(); },
+		[&] (auto engine) { return rng::normal_engine<T, decltype(engine)>(T(0), T(1), engine); },
+		[&] (auto& engine, span<T> values) { rng::fill_normal(engine, values); });
+	bench_distribution<T>(runner, "exponential/" + name, continuous([] (double x) { return -std::expm1(-x); }, 1.0, 1.0),
+		[&] () { return rng::exponential<T>(); },
+		[&] () { return rng::exponential_gen<T>(); },
+		[&] (auto engine) { return rng::exponential_engine<T, decltype(engine)>(T(1), engine); },
+		[&] (auto& engine, span<T> values) { rng::fill_exponential(engine, values); });
+}
+
+} // anonymous
+
+int main(int argc, char** argv) {
+	bench::runner runner(argc, argv);
+	rng::seed(seed);
+
+#define X(type) \
+	bench_uniform_ab<type>(runner, #type, std::is_floating_point<type>());
+COMMON_NUMERIC_TYPES
+#undef X
+
+#define X(type) \
+	bench_geometric<type>(runner, #type);
+INTEGRAL_NUMERIC_TYPES
+#undef X
+
+#define X(type) \
+	bench_real<type>(runner, #type);
+REAL_NUMERIC_TYPES
+#undef X
+
+	return 0;
+}
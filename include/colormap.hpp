@@ -0,0 +1,81 @@
+/*
+ * damogran - c++ opengl wrapper library
+ *
+ * Written in 2014 by Richard Vock
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright and related and neighboring rights to this software to the public domain worldwide.
+ * This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with this software.
+ * If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#ifndef DAMOGRAN_COLORMAP_HPP_
+#define DAMOGRAN_COLORMAP_HPP_
+
+#include <vector>
+#include "colors.hpp"
+
+namespace damogran {
+
+
+// Maps scalar values to colors through a lookup table of fixed resolution
+// sampled once from a gradient (or taken from a discrete palette). Values
+// below lower/above upper (and NaN) are clamped to the first/last entry.
+// Gradients interpolate channel-wise in the space of ColorType.
+template <class ColorType>
+class colormap {
+	public:
+		typedef std::shared_ptr<colormap>        ptr;
+		typedef std::weak_ptr<colormap>          wptr;
+		typedef std::shared_ptr<const colormap>  const_ptr;
+		typedef std::weak_ptr<const colormap>    const_wptr;
+		typedef ColorType color_type;
+		typedef typename ColorType::scalar_type scalar_type;
+		typedef std::pair<float, color_type> stop_type;
+		typedef std::vector<color_type, Eigen::aligned_allocator<color_type>> table_type;
+
+	public:
+		// gradient through evenly spaced stops
+		colormap(const std::vector<color_type>& stops, float lower = 0.f, float upper = 1.f, uint32_t resolution = 1024);
+		// gradient through stops at positions in [0, 1] (relative to [lower, upper])
+		colormap(const std::vector<stop_type>& stops, float lower = 0.f, float upper = 1.f, uint32_t resolution = 1024);
+		virtual ~colormap();
+
+		// splits [lower, upper] into palette.size() equal bins without interpolation
+		static colormap discrete(const std::vector<color_type>& palette, float lower = 0.f, float upper = 1.f);
+
+		float lower() const;
+		float upper() const;
+		const table_type& table() const;
+
+		color_type operator()(float value) const;
+
+		void map(span<const float> values, span<color_type> output) const;
+
+		// Colorizes a stream chunk by chunk through fixed size buffers:
+		// produce(span<float>) fills the buffer and returns the number of values
+		// written (0 ends the stream), consume(span<const color_type>) receives
+		// the colors of each chunk. Returns the number of mapped values.
+		template <typename Producer, typename Consumer>
+		std::size_t stream(Producer&& produce, Consumer&& consume, std::size_t chunk_size = 65536) const;
+
+	protected:
+		colormap(float lower, float upper);
+
+		void sample(const std::vector<stop_type>& stops, uint32_t resolution);
+
+	protected:
+		float      lower_;
+		float      upper_;
+		float      scale_;
+		float      offset_;
+		table_type table_;
+};
+
+#include "colormap.ipp"
+
+} // damogran
+
+#endif /* DAMOGRAN_COLORMAP_HPP_ */
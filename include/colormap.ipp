@@ -0,0 +1,14 @@
+template <class ColorType>
+template <typename Producer, typename Consumer>
+inline std::size_t colormap<ColorType>::stream(Producer&& produce, Consumer&& consume, std::size_t chunk_size) const {
+	std::vector<float> values(chunk_size);
+	table_type colors(chunk_size);
+	std::size_t total = 0;
+	while (std::size_t count = produce(span<float>(values.data(), values.size()))) {
+		count = std::min(count, chunk_size);
+		map(span<const float>(values.data(), count), span<color_type>(colors.data(), count));
+		consume(span<const color_type>(colors.data(), count));
+		total += count;
+	}
+	return total;
+}
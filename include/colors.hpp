@@ -15,7 +15,10 @@
 #define DAMOGRAN_COLORS_HPP_
 
 #include <vector>
+#include <cstdint>
+#include <cstring>
 #include "common.hpp"
+#include "span.hpp"
 
 namespace damogran {
 
@@ -40,11 +43,11 @@ class RGB : public col_vec3_t<Scalar> {
 	public:
 		RGB();
 		RGB(Scalar r, Scalar g, Scalar b);
-		RGB(const RGB<Scalar>& rgb);
+		RGB(const RGB<Scalar>& rgb) = default;
+		RGB& operator=(const RGB<Scalar>& rgb) = default;
 		RGB(const RGBA<Scalar>& rgba);
 		RGB(const HSV<Scalar>& hsv);
 		RGB(const HSVA<Scalar>& hsva);
-		virtual ~RGB();
 
 		Scalar& r() {
 			return (*this)[0];
@@ -80,10 +83,10 @@ class RGBA : public col_vec4_t<Scalar> {
 		RGBA();
 		RGBA(Scalar r, Scalar g, Scalar b, Scalar a = Scalar(1));
 		RGBA(const RGB<Scalar>& rgb);
-		RGBA(const RGBA<Scalar>& rgba);
+		RGBA(const RGBA<Scalar>& rgba) = default;
+		RGBA& operator=(const RGBA<Scalar>& rgba) = default;
 		RGBA(const HSV<Scalar>& hsv);
 		RGBA(const HSVA<Scalar>& hsva);
-		virtual ~RGBA();
 
 		Scalar& r() {
 			return (*this)[0];
@@ -128,9 +131,9 @@ class HSV : public col_vec3_t<Scalar> {
 		HSV(Scalar h, Scalar s, Scalar v);
 		HSV(const RGB<Scalar>& rgb);
 		HSV(const RGBA<Scalar>& rgba);
-		HSV(const HSV<Scalar>& hsv);
+		HSV(const HSV<Scalar>& hsv) = default;
+		HSV& operator=(const HSV<Scalar>& hsv) = default;
 		HSV(const HSVA<Scalar>& hsva);
-		virtual ~HSV();
 
 		Scalar& h() {
 			return (*this)[0];
@@ -168,8 +171,8 @@ class HSVA : public col_vec4_t<Scalar> {
 		HSVA(const RGB<Scalar>& rgb);
 		HSVA(const RGBA<Scalar>& rgba);
 		HSVA(const HSV<Scalar>& hsv);
-		HSVA(const HSVA<Scalar>& hsva);
-		virtual ~HSVA();
+		HSVA(const HSVA<Scalar>& hsva) = default;
+		HSVA& operator=(const HSVA<Scalar>& hsva) = default;
 
 		Scalar& h() {
 			return (*this)[0];
@@ -213,9 +216,143 @@ struct generate {
 	static color_type random_hue(scalar_type value = scalar_type(1), scalar_type saturation = scalar_type(1), scalar_type alpha = scalar_type(1));
 	static std::vector<color_type> random_hues(uint32_t count, scalar_type value = scalar_type(1), scalar_type saturation = scalar_type(1), scalar_type alpha = scalar_type(1));
 	static std::vector<color_type> uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha = scalar_type(1));
+
+	// Fill caller supplied buffers in parallel (threads = 0 uses all cores).
+	// Work is split into fixed chunks with one random stream per chunk, so the
+	// output for a given seed does not depend on the number of threads.
+	static void random_hues(span<color_type> output, uint64_t seed, scalar_type value = scalar_type(1), scalar_type saturation = scalar_type(1), scalar_type alpha = scalar_type(1), unsigned int threads = 0);
+	static void uniform(span<color_type> output, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha = scalar_type(1), unsigned int threads = 0);
 	static std::vector<color_type> shuffled_uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha = scalar_type(1));
 };
 
+// Nearest color lookup in a fixed palette (k-d tree). Distances are
+// euclidean on channels normalized to [0, 1]; HSV hues are measured along
+// the circle (as fraction of a full turn) so red at both ends of the hue
+// range is treated as one color. Alpha is ignored.
+template <class ColorType>
+class palette_index {
+	public:
+		typedef ColorType color_type;
+		typedef typename ColorType::scalar_type scalar_type;
+
+	public:
+		palette_index(const std::vector<color_type>& palette);
+
+		const std::vector<color_type>& palette() const;
+
+		uint32_t nearest(const color_type& color) const;
+
+		// batched queries, chunked over threads (0 uses all cores)
+		void nearest(span<const color_type> colors, span<uint32_t> indices, unsigned int threads = 0) const;
+
+		// replaces every color by its nearest palette entry
+		void quantize(span<const color_type> colors, span<color_type> output, unsigned int threads = 0) const;
+
+	protected:
+		struct node {
+			Eigen::Vector3f lower;
+			Eigen::Vector3f upper;
+			uint32_t begin;
+			uint32_t end;
+			int32_t  children[2];
+		};
+
+		Eigen::Vector3f coords(const color_type& color) const;
+		float box_distance(const Eigen::Vector3f& point, const node& n) const;
+		float distance(const Eigen::Vector3f& a, const Eigen::Vector3f& b) const;
+		int32_t build(uint32_t begin, uint32_t end);
+		void search(int32_t node_index, const Eigen::Vector3f& point, uint32_t& best, float& best_distance) const;
+
+	protected:
+		std::vector<color_type>      palette_;
+		std::vector<Eigen::Vector3f> points_;
+		std::vector<uint32_t>        order_;
+		std::vector<node>            nodes_;
+};
+
+// Non-owning view over packed color channels in a raw (e.g. image or vertex)
+// buffer. Colors are read and written in place; stride is the byte distance
+// between consecutive colors and defaults to tightly packed channels.
+// Use packed_color_view<const ColorType> for read-only buffers.
+template <class ColorType>
+class packed_color_view {
+	public:
+		typedef typename std::remove_const<ColorType>::type color_type;
+		typedef typename color_type::scalar_type scalar_type;
+		typedef typename std::conditional<std::is_const<ColorType>::value, const uint8_t, uint8_t>::type byte_type;
+
+		static constexpr int channels = color_type::RowsAtCompileTime;
+		static constexpr std::size_t packed_size = channels * sizeof(scalar_type);
+
+	public:
+		packed_color_view(byte_type* data, std::size_t count, std::size_t stride = packed_size) : data_(data), size_(count), stride_(stride) {}
+
+		// adds const only, views of other color types need an explicit stride
+		template <typename C, typename = typename std::enable_if<std::is_same<typename packed_color_view<C>::color_type, color_type>::value && std::is_convertible<typename packed_color_view<C>::byte_type*, byte_type*>::value>::type>
+		packed_color_view(const packed_color_view<C>& other) : data_(other.data()), size_(other.size()), stride_(other.stride()) {}
+
+		byte_type* data() const { return data_; }
+		std::size_t size() const { return size_; }
+		std::size_t stride() const { return stride_; }
+
+		color_type get(std::size_t i) const {
+			color_type color;
+			std::memcpy(color.data(), data_ + i * stride_, packed_size);
+			return color;
+		}
+
+		void set(std::size_t i, const color_type& color) const {
+			std::memcpy(data_ + i * stride_, color.data(), packed_size);
+		}
+
+		// true if the buffer can be aliased as an array of color_type
+		bool contiguous() const {
+			return stride_ == sizeof(color_type) && reinterpret_cast<std::uintptr_t>(data_) % alignof(color_type) == 0;
+		}
+
+		span<ColorType> colors() const {
+			if (!contiguous()) {
+				throw std::runtime_error("packed_color_view::colors: Buffer is strided or misaligned.");
+			}
+			return span<ColorType>(reinterpret_cast<ColorType*>(data_), size_);
+		}
+
+	protected:
+		byte_type*  data_;
+		std::size_t size_;
+		std::size_t stride_;
+};
+
+// Converts input[i] to output[i] for whole buffers; both spans must be of equal size.
+// RGB <-> HSV conversions run on SoA float lanes (SSE2/AVX2 if available) and
+// yield exactly the same values as the per-color constructors.
+template <class TargetType, class SourceType>
+void convert(span<const SourceType> input, span<TargetType> output);
+
+template <class TargetType, class SourceType>
+void convert(packed_color_view<const SourceType> input, packed_color_view<TargetType> output);
+
+// Table driven variant of convert() for 8 and 16 bit scalars (char, unsigned
+// char and short). Tables are built once on first use and conversion is
+// integer only; results are within one unit of convert().
+template <class TargetType, class SourceType>
+void convert_lut(span<const SourceType> input, span<TargetType> output);
+
+template <class TargetType, class SourceType>
+void convert_lut(packed_color_view<const SourceType> input, packed_color_view<TargetType> output);
+
+// Integer only variant of convert() for integral scalars (short, int,
+// unsigned int, char and unsigned char). Channels are processed as 16 bit
+// fixed point values (HSV -> RGB on SSE2 16 bit lanes). Compared to
+// convert(), RGB -> HSV results differ by at most one unit; HSV -> RGB
+// results by at most 1 (char, unsigned char), 4 (short) or 8 (int,
+// unsigned int) units.
+template <class TargetType, class SourceType>
+void convert_fixed(span<const SourceType> input, span<TargetType> output);
+
+template <class TargetType, class SourceType>
+void convert_fixed(packed_color_view<const SourceType> input, packed_color_view<TargetType> output);
+
 
 } // damogran
 
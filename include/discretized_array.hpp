@@ -42,6 +42,10 @@ class discretized_array {
 		key_type discretize(const float_key_type& desc) const;
 		float_key_type interpolate(const key_type& desc, float interpolation_param = 0.f) const;
 
+		// values in index order, i.e. the last key dimension varies fastest
+		const std::vector<value_type>& data() const;
+		std::vector<value_type>& data();
+
 		template <typename Func>
 		void forall_keys(Func&& func);
 
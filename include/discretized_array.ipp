@@ -48,6 +48,16 @@ inline typename discretized_array<D,T>::float_key_type discretized_array<D,T>::i
 	return (key.template cast<float>() + float_key_type::Constant(interpolation_param)).cwiseProduct(deltas_) + lower_bounds_;
 }
 
+template <int D, typename T>
+inline const std::vector<typename discretized_array<D,T>::value_type>& discretized_array<D,T>::data() const {
+	return data_;
+}
+
+template <int D, typename T>
+inline std::vector<typename discretized_array<D,T>::value_type>& discretized_array<D,T>::data() {
+	return data_;
+}
+
 template <int D, typename T>
 template <typename Func>
 inline void discretized_array<D,T>::forall_keys(Func&& func) {
@@ -23,6 +23,15 @@
 	X(float) \
 	X(double)
 
+#define COLOR_SCALAR_TYPES \
+	X(float) \
+	X(double) \
+	X(short) \
+	X(int) \
+	X(unsigned int) \
+	X(char) \
+	X(unsigned char)
+
 #define DURATION_TYPES \
 	X(std::chrono::hours) \
 	X(std::chrono::minutes) \
@@ -0,0 +1,57 @@
+#ifndef DAMOGRAN_PARALLEL_HPP_
+#define DAMOGRAN_PARALLEL_HPP_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+namespace damogran {
+
+// Splits [0, count) into consecutive chunks of chunk_size elements and calls
+// func(chunk, begin, end) for each of them on up to `threads` threads
+// (0 selects std::thread::hardware_concurrency()). Chunk boundaries depend on
+// chunk_size only, so anything derived from the chunk index is independent of
+// the number of threads. The first exception thrown by func is rethrown.
+template <typename Func>
+inline void parallel_chunks(std::size_t count, std::size_t chunk_size, Func&& func, unsigned int threads = 0) {
+	if (!count) return;
+	chunk_size = std::max(chunk_size, std::size_t(1));
+	std::size_t chunks = (count + chunk_size - 1) / chunk_size;
+	if (!threads) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	threads = static_cast<unsigned int>(std::min<std::size_t>(threads, chunks));
+
+	std::atomic<std::size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto work = [&] () {
+		for (std::size_t chunk = next++; chunk < chunks; chunk = next++) {
+			try {
+				func(chunk, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) error = std::current_exception();
+				next = chunks;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threads; ++i) {
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	if (error) std::rethrow_exception(error);
+}
+
+
+} // damogran
+
+#endif /* DAMOGRAN_PARALLEL_HPP_ */
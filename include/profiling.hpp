@@ -3,7 +3,13 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <atomic>
+#include <mutex>
 #include <chrono>
+#include <cstdint>
+#include <array>
+#include <fstream>
 
 #include "common.hpp"
 
@@ -20,23 +26,339 @@ class profiling {
 		typedef std::shared_ptr<const profiling>  const_ptr;
 		/** Weak const pointer to this class */
 		typedef std::weak_ptr<const profiling>    const_wptr;
+		/** Interned profile name */
+		typedef uint32_t                          id_t;
+
+		/** Hardware counters, see enable_counters() */
+		enum counter {
+			cycles,
+			instructions,
+			branches,
+			branch_misses,
+			l1d_misses,
+			llc_misses,
+			context_switches,
+			counter_count
+		};
+		typedef std::array<uint64_t, counter_count> counter_values;
+
+		/** Heap allocations of a profile, see enable_allocations() */
+		struct allocation_values {
+			/** Number of allocations */
+			uint64_t count;
+			/** Requested bytes */
+			uint64_t bytes;
+			/** Most bytes held at once, net of frees */
+			uint64_t peak_bytes;
+		};
+
+		/**
+		 *  Clock used for all profiles, see profiling::clock.
+		 */
+		class clock {
+			public:
+				typedef std::chrono::nanoseconds             duration;
+				typedef duration::rep                        rep;
+				typedef duration::period                     period;
+				typedef std::chrono::time_point<clock>       time_point;
+				static constexpr bool                        is_steady = true;
+
+				/** Time sources the clock can read */
+				enum source {
+					steady,
+					tsc
+				};
+
+				static inline time_point now();
+
+				/**
+				 *  Selects the time source of the clock.
+				 *
+				 *  Selecting tsc calibrates the time stamp counter against
+				 *  std::chrono::steady_clock first, unless it has been
+				 *  calibrated before, and fails if the counter is not usable
+				 *  or has drifted from steady_clock before.
+				 *
+				 *  @param s Time source to read.
+				 *  @return Whether s is now the time source.
+				 */
+				static bool use(source s);
+
+				/**
+				 *  @return Current time source.
+				 */
+				static source current();
+
+				/**
+				 *  @return Calibrated time stamp counter frequency in Hz or 0
+				 *          if the counter is not usable.
+				 */
+				static double frequency();
+
+				/**
+				 *  Compares the clock against std::chrono::steady_clock and
+				 *  falls back to the latter if they drifted apart.
+				 *
+				 *  @return Whether the clock still agrees with steady_clock.
+				 */
+				static bool check();
+
+			protected:
+				// selects the startup source once profiling is used
+				static void initialize();
+				// calibrates the time stamp counter once, returns whether it is usable
+				static bool calibrate();
+				// time stamp counter converted to steady_clock nanoseconds
+				static rep tsc_now();
+
+				static std::atomic<int> source_;
+				// steady_clock nanoseconds = base_ns_ + ((ticks - base_ticks_) * mult_ >> 32)
+				static uint64_t         base_ticks_;
+				static rep              base_ns_;
+				static uint64_t         mult_;
+				static double           frequency_;
+				// set by check() once the counter drifted
+				static std::atomic<bool> drifted_;
+
+				friend class profiling;
+		};
 
 	protected:
-		typedef std::chrono::steady_clock       clock_t;
+		typedef clock                           clock_t;
 		typedef std::chrono::time_point<clock_t>  time_point_t;
 		typedef clock_t::duration                 duration_t;
-		struct TimeInfo {
+		typedef duration_t::rep                   rep_t;
+
+		// Node of a thread's call tree, one per distinct path of profiles.
+		// Only the owning thread writes the atomics (plain load/store, no
+		// read-modify-write), so summarize() can read them from any thread
+		// without locking.
+		struct node {
+			id_t                  id;
+			uint32_t              parent;
+			// children as a linked list, used by the owning thread only
+			uint32_t              first_child;
+			uint32_t              next_sibling;
+			std::atomic<rep_t>    inclusive;
+			std::atomic<uint64_t> calls;
+			// frames of this node on the scope stack
+			std::atomic<uint32_t> open;
+			// latency histogram counts (histogram::bucket_count) and extrema
+			// in nanoseconds
+			std::atomic<uint64_t>* buckets;
+			std::atomic<uint64_t>  min_ns;
+			std::atomic<uint64_t>  max_ns;
+			// inclusive hardware counter deltas
+			std::atomic<uint64_t>  counters[counter_count];
+			// exclusive heap allocations and inclusive peak live bytes,
+			// the peak is never reset
+			std::atomic<uint64_t>  allocations;
+			std::atomic<uint64_t>  allocated_bytes;
+			std::atomic<uint64_t>  peak_bytes;
+			// totals already reported by summarize()
+			rep_t                 reported_inclusive;
+			uint64_t              reported_calls;
+			std::vector<uint64_t> reported_buckets;
+			counter_values        reported_counters;
+			uint64_t              reported_allocations;
+			uint64_t              reported_allocated_bytes;
+		};
+
+		struct thread_buffer;
+
+		struct frame {
+			uint32_t     node;
 			time_point_t start;
-			duration_t  passed;
-			bool      finished;
+			// calls this frame stands for, the product of the periods of
+			// the sampled scopes open down to it
+			uint64_t     weight;
+			// counter values at the start are in counter_starts
+			bool         counted;
+			// live bytes of the buffer at the start and their maximum
+			// while the frame was open
+			int64_t      live_base;
+			int64_t      live_peak;
+			// buffer charged with allocations before the frame opened,
+			// restored when it closes
+			thread_buffer* allocating;
+		};
+
+		// closed profile for the trace timeline
+		struct trace_event {
+			id_t  id;
+			rep_t start;
+			rep_t duration;
+		};
+
+		// Single producer (the owning thread), single consumer
+		// (flush_trace()) ring of trace events. Events are dropped and
+		// counted while the ring is full.
+		struct trace_ring {
+			explicit trace_ring(std::size_t capacity);
+
+			inline void push(const trace_event& event);
+
+			std::vector<trace_event> events;
+			std::size_t              mask;
+			std::atomic<uint64_t>    head;
+			std::atomic<uint64_t>    tail;
+			std::atomic<uint64_t>    dropped;
+			uint64_t                 reported_dropped;
+		};
+
+		// Call tree and scope stack of one thread. Node 0 is the root and
+		// stack[0] its frame. Nodes are appended after their parent into
+		// blocks that never move and published through size, so readers can
+		// walk [0, size) without locking. Block b holds block_size << b
+		// nodes, so short trees stay small. When its thread exits, the
+		// buffer is folded into the exited threads' buffer (index exited)
+		// and handed to the next new thread.
+		struct thread_buffer {
+			static constexpr uint32_t    none = ~0u;
+			static constexpr std::size_t exited = ~std::size_t(0);
+			static constexpr std::size_t block_size = 16;
+			static constexpr std::size_t max_blocks = 20;
+
+			explicit thread_buffer(std::size_t index);
+			~thread_buffer();
+
+			static std::size_t block_of(uint32_t index) {
+				// floor(log2(index / block_size + 1))
+				unsigned long long slot = index / block_size + 1;
+#ifdef __GNUC__
+				return static_cast<std::size_t>(63 - __builtin_clzll(slot));
+#else
+				std::size_t b = 0;
+				while (slot >>= 1) ++b;
+				return b;
+#endif
+			}
+
+			node& at(uint32_t index) const {
+				const std::size_t b = block_of(index);
+				return blocks[b].load(std::memory_order_acquire)[index - block_size * ((std::size_t(1) << b) - 1)];
+			}
+
+			// pushes a frame of the child of the current node with the given
+			// id, pops the top frame
+			inline void enter(id_t id, uint32_t period);
+			inline void leave(time_point_t now);
+			uint32_t append(uint32_t parent, id_t id);
+			// adds the unreported totals of other, whose nodes become
+			// reported, by path
+			void absorb(thread_buffer& other);
+			// drops all nodes and frames for a new owning thread
+			void reset();
+
+			// opens or closes the counters to match counters_wanted
+			void update_counters();
+			bool read_counters(counter_values& values) const;
+			bool begin_counters(std::size_t depth);
+			void end_counters(node& n, std::size_t depth, uint64_t weight);
+
+			std::size_t            index;
+			uint64_t               thread_id;
+			std::atomic<uint32_t>  size;
+			std::atomic<node*>     blocks[max_blocks];
+			std::vector<frame>     stack;
+			// ring of the running trace, nullptr while not tracing
+			std::atomic<trace_ring*>                  ring;
+			// rings ever used by this thread, kept until destruction
+			std::vector<std::unique_ptr<trace_ring>>  rings;
+			// perf event group of the thread, opened and closed by the
+			// owning thread on its next enter() after counters_wanted changed;
+			// counters_applied is the state last applied, -1 marks counters
+			// that are closed or unavailable
+			std::atomic<bool>            counters_wanted;
+			bool                         counters_applied;
+			int                          counter_fds[counter_count];
+			// bit c set if counter c could be opened
+			std::atomic<uint32_t>        counter_mask;
+			std::vector<counter_values>  counter_starts;
+			// bytes allocated minus bytes freed by the owning thread while
+			// one of its profiles was running
+			int64_t                      live;
+			// unsampled passes of sampled scopes open on the owning
+			// thread, nothing nested in them is recorded
+			uint32_t                     suppressed;
 		};
 
 	public:
-		/** 
-		 *  Constructor 
+		class scope;
+		class histogram;
+
+	public:
+		/**
+		 *  Constructor
 		 */
 		profiling();
 
+		/**
+		 *  Destructor
+		 *
+		 *  No thread may record into this instance while it is destroyed.
+		 */
+		~profiling();
+
+		profiling(const profiling&) = delete;
+		profiling& operator=(const profiling&) = delete;
+
+		/**
+		 *  Enables or disables profiling of all instances at runtime.
+		 *
+		 *  While disabled, starting a profile or entering a profiled scope
+		 *  costs a single branch; profiles started before are still ended
+		 *  and reported. Profiling starts enabled if the library was built
+		 *  with PROFILING defined, which the environment variable
+		 *  DAMOGRAN_PROFILING overrides (0 or off disables, other values
+		 *  enable).
+		 *
+		 *  @param enabled Whether profiles are recorded.
+		 */
+		static void enable(bool enabled = true);
+
+		/**
+		 *  @return Whether profiling is enabled.
+		 */
+		static bool enabled() {
+			return enabled_.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 *  Process-wide instance used by DAMOGRAN_PROFILE_SCOPE.
+		 *
+		 *  @return Global profiling instance.
+		 */
+		static profiling& global();
+
+		/**
+		 *  Returns the id of the profile with the given name.
+		 *
+		 *  Ids are shared by all instances and stable for the lifetime of
+		 *  the process.
+		 *
+		 *  @param name Name of the profile.
+		 *  @return Id of the profile.
+		 */
+		static id_t id(const std::string& name);
+
+		/**
+		 *  Returns the id of the profile with the given name, without
+		 *  building a string at the call site.
+		 *
+		 *  @param name Name of the profile.
+		 *  @return Id of the profile.
+		 */
+		static id_t id(const char* name);
+
+		/**
+		 *  Returns the name of the profile with the given id.
+		 *
+		 *  @param id Id obtained from id(const std::string&).
+		 *  @return Name of the profile.
+		 */
+		static std::string name(id_t id);
+
 		/**
 		 *  Start/restarts new profile with given name.
 		 *
@@ -50,19 +372,44 @@ class profiling {
 		 *  and any measured time is added to the entire measurement of
 		 *  the profile.
 		 *
+		 *  Profiles are recorded per thread into thread-local buffers, so
+		 *  any number of threads may use the same instance concurrently
+		 *  without locking. A profile must be ended on the thread that
+		 *  started it and is nested under the profiles running on that
+		 *  thread when it starts. Does nothing while profiling is
+		 *  disabled, see enable().
+		 *
 		 *  @param name Unique name of the profile to be started.
 		 */
-		void start(std::string name);
+		void start(const std::string& name);
+
+		/**
+		 *  Start/restarts the profile with the given id.
+		 *
+		 *  Same as start(const std::string&) without the name lookup.
+		 *
+		 *  @param id Id of the profile to be started.
+		 */
+		void start(id_t id);
 
 		/**
 		 *  Ends measurement of given profile.
 		 *
 		 *  When called, this member function records the time passed
-		 *  since the last call to start(std::string name).
+		 *  since the last call to start(std::string name) on the calling
+		 *  thread. Profiles started after it and still running are ended as
+		 *  well and reported as unfinished by the next summarize().
 		 *
 		 *  @param name Unique name of the profile used for the start call.
 		 */
-		void end(std::string name);
+		void end(const std::string& name);
+
+		/**
+		 *  Ends measurement of the profile with the given id.
+		 *
+		 *  @param id Id of the profile used for the start call.
+		 */
+		void end(id_t id);
 
 		/**
 		 *  Starts/stops profiles depending on their current status.
@@ -73,7 +420,7 @@ class profiling {
 		 *
 		 *  @param name Unique name of profile to start/stop.
 		 */
-		void profile(std::string name);
+		void profile(const std::string& name);
 
 		/**
 		 *  Print summary of all measured profiles.
@@ -90,27 +437,463 @@ class profiling {
 		 *
 		 *  The printed unit names and values are changed accordingly.
 		 *
+		 *  Profiles are printed as a call tree merged over all threads:
+		 *  a profile started while others are running on the same thread is
+		 *  listed under the innermost of them. Every line shows inclusive
+		 *  time, exclusive time (without nested profiles), call count and
+		 *  percentage of the parent's inclusive time, then the latency
+		 *  distribution of the calls (min, mean, p50, p90, p99, p99.9, max)
+		 *  and one line per thread if several threads recorded it. Buffers of
+		 *  exited threads are reused by new threads, so memory stays bounded
+		 *  by the number of concurrent threads: top-level profiles keep a
+		 *  line per exited thread for the first max_exited_threads threads
+		 *  exiting between two calls, later ones and nested profiles are
+		 *  summed into one "[exited threads]" line. "Summed:" adds the
+		 *  top-level profiles only, so nested time is not counted twice.
+		 *
+		 *  Profiles still running on the calling thread are ended, those
+		 *  running on other threads are reported as unfinished. Printed
+		 *  measurements are not reported again by later calls.
+		 *
 		 *  @tparam DurationType Unit of measurement to use for the printed duration.
 		 *  @param logFunction If given, this callback function is used to print the summary, otherwise std::cout is used.
 		 */
 		template <class DurationType>
 		void summarize(std::function<void (std::string)> logFunction = nullptr);
 
+		/** Exited threads kept apart per summarize(), see summarize() */
+		static constexpr std::size_t max_exited_threads = 256;
+
+		/**
+		 *  Total duration of a profile over all threads since the last
+		 *  summarize(). Time spent in recursive calls of the profile is
+		 *  counted once.
+		 *
+		 *  @tparam DurationType Unit of measurement of the result.
+		 *  @param profile Name of the profile.
+		 *  @return Measured duration or 0 if the profile is unknown.
+		 */
 		template <class DurationType>
-		typename DurationType::rep duration(std::string profile) const;
+		typename DurationType::rep duration(const std::string& profile) const;
+
+		/**
+		 *  Latency distribution of a profile over all threads since the
+		 *  last summarize(). As for duration(), recursive calls are
+		 *  contained in the outermost one.
+		 *
+		 *  @param profile Name of the profile.
+		 *  @return Histogram of the call durations, empty if the profile is unknown.
+		 */
+		histogram distribution(const std::string& profile) const;
+
+		/**
+		 *  Starts recording a timeline of all profiles into a Chrome Trace
+		 *  Event file (JSON), which chrome://tracing and ui.perfetto.dev open.
+		 *
+		 *  Every thread records the profiles it closes into a preallocated
+		 *  ring of events_per_thread events, from which flush_trace() and
+		 *  stop_trace() append them to the file. Events that do not fit into
+		 *  a full ring are dropped and marked in the timeline, so
+		 *  long-running traces should be flushed periodically. A running
+		 *  trace is stopped first.
+		 *
+		 *  @param path File to write the trace to.
+		 *  @param events_per_thread Capacity of the ring of every thread, rounded up to a power of two.
+		 */
+		void start_trace(const std::string& path, std::size_t events_per_thread = 1 << 16);
+
+		/**
+		 *  Appends the events recorded since the last flush to the trace file.
+		 *
+		 *  May be called from any thread, e.g. periodically from a
+		 *  background thread, while others record.
+		 *
+		 *  @return Number of events written.
+		 */
+		std::size_t flush_trace();
+
+		/**
+		 *  Flushes and closes the trace file. Profiles still running are not
+		 *  part of the trace.
+		 */
+		void stop_trace();
+
+		/**
+		 *  Enables or disables hardware performance counters for all
+		 *  profiles.
+		 *
+		 *  While enabled, every thread reads the counters of
+		 *  Linux perf_event_open (cycles, instructions, branches, branch
+		 *  misses, L1 data cache read misses and last level cache misses in
+		 *  user space, context switches of the thread) when profiles
+		 *  start and end, and summarize() prints their inclusive deltas with
+		 *  IPC and miss rates. Each read is a system call, so expect about a
+		 *  microsecond of overhead per profile. Counters the kernel refuses
+		 *  (perf_event_paranoid, containers, virtual machines or other
+		 *  platforms) are left out, profiling itself is unaffected.
+		 *
+		 *  @param enable Whether counters should be recorded.
+		 *  @return Whether any counter can be read on the calling thread.
+		 */
+		bool enable_counters(bool enable = true);
+
+		/**
+		 *  Inclusive hardware counter deltas of a profile over all threads
+		 *  since the last summarize().
+		 *
+		 *  @param profile Name of the profile.
+		 *  @return Counter deltas indexed by counter, zero for unavailable counters.
+		 */
+		counter_values counters(const std::string& profile) const;
+
+		/**
+		 *  Enables or disables heap allocation accounting for all
+		 *  instances.
+		 *
+		 *  While enabled, every operator new and delete is attributed to
+		 *  the innermost profile running on the allocating thread, and
+		 *  summarize() prints allocation counts, requested bytes and the
+		 *  peak of bytes held at once (allocated minus freed, including
+		 *  nested profiles) per profile. Allocations outside of profiles
+		 *  are not counted. The hooks replace the global operators of
+		 *  new and delete and are only built with PROFILING_ALLOCATIONS
+		 *  defined (cmake -DDAMOGRAN_PROFILE_ALLOCATIONS=ON) on glibc;
+		 *  while disabled, they cost a branch per allocation.
+		 *
+		 *  @param enable Whether allocations should be recorded.
+		 *  @return Whether allocations are recorded.
+		 */
+		static bool enable_allocations(bool enable = true);
+
+		/**
+		 *  Heap allocations of a profile over all threads since the last
+		 *  summarize(). The peak is the largest of any thread since the
+		 *  profile was first recorded.
+		 *
+		 *  @param profile Name of the profile.
+		 *  @return Allocations of the profile, zero if none were recorded.
+		 */
+		allocation_values allocations(const std::string& profile) const;
 
 	protected:
+		// buffer of the calling thread, registered on first use if create
+		// is set, nullptr otherwise and while the thread exits
+		inline thread_buffer* local(bool create);
+		thread_buffer* lookup(bool create);
+
 		template <class DurationType>
 		std::string format(std::string name, typename DurationType::rep duration);
 
+		template <class DurationType>
+		std::string format(std::string name, typename DurationType::rep inclusive, typename DurationType::rep exclusive, uint64_t calls, double percent);
+
+		template <class DurationType>
+		std::string format(const histogram& latency);
+
+		std::string format(const counter_values& values, uint32_t mask);
+
+		std::string format(const allocation_values& values);
+
 		template <class DurationType>
 		std::string unit();
 
+		// histogram of the calls of n since the last summarize(), which
+		// becomes the new baseline if consume is set
+		static histogram delta(node& n, bool consume);
+
+		// keeps memory of the profiler itself out of the allocations of
+		// the running profile while alive
+		struct unaccounted {
+			unaccounted() : outer(allocating_) {
+				allocating_ = nullptr;
+			}
+			~unaccounted() {
+				allocating_ = outer;
+			}
+			thread_buffer* outer;
+		};
+
+		// owner of the calling thread's buffers, retires them on thread exit
+		struct registrations;
+
+		// folds the buffer of the exiting calling thread into exited_ and
+		// keeps it for reuse
+		void retire(thread_buffer& buffer);
+
+		// makes buffer record into a ring of trace_capacity_ events
+		void attach_trace(thread_buffer& buffer);
+		std::size_t write_trace();
+
 	protected:
-		std::map< std::string, TimeInfo >  profiles_;
+		uint64_t                                     serial_;
+		mutable std::mutex                           threads_mutex_;
+		std::vector<std::unique_ptr<thread_buffer>>  threads_;
+		// totals of exited threads, also in threads_, nullptr until the
+		// first thread exits
+		thread_buffer*                               exited_;
+		// retired buffers for new threads
+		std::vector<thread_buffer*>                  free_;
+		// unreported totals of the top-level profiles of exited threads,
+		// also in exited_, for the per-thread lines of summarize()
+		struct exited_total {
+			std::size_t thread;
+			uint64_t    thread_id;
+			id_t        id;
+			rep_t       inclusive;
+			uint64_t    calls;
+		};
+		std::vector<exited_total>                    exited_totals_;
+		// threads in exited_totals_, at most max_exited_threads
+		std::size_t                                  exited_threads_;
+
+		// profiles ended by end() of an enclosing profile, reported by
+		// summarize()
+		std::mutex                                   unfinished_mutex_;
+		std::vector<std::string>                     unfinished_;
+
+		// guards the trace file, taken before threads_mutex_
+		std::mutex                                   trace_mutex_;
+		std::unique_ptr<std::ofstream>               trace_file_;
+		std::atomic<std::size_t>                     trace_capacity_;
+		time_point_t                                 trace_start_;
+		bool                                         trace_first_;
+		std::vector<bool>                            trace_named_;
+		std::atomic<bool>                            counters_enabled_;
+
+		static std::atomic<bool>                     enabled_;
+		static std::atomic<bool>                     allocations_enabled_;
+
+		// buffer of the innermost profile running on the calling thread,
+		// which allocations are attributed to
+		static thread_local thread_buffer* allocating_;
+
+		// buffer of the instance the calling thread used last
+		static thread_local uint64_t       cached_serial_;
+		static thread_local thread_buffer* cached_buffer_;
+
+		friend struct allocation_hooks;
+};
+
+
+/**
+ *  Log-bucketed histogram of durations in nanoseconds.
+ *
+ *  Values below 32ns have buckets of their own, above that every power of
+ *  two is split into 16 buckets, bounding the relative error of reported
+ *  percentiles by 1/32. Durations of 2^41ns (about 37 minutes) and more
+ *  share the last bucket. Recording is O(1) and histograms of different
+ *  threads or runs merge by adding bucket counts.
+ */
+class profiling::histogram {
+	public:
+		static constexpr std::size_t linear_buckets = 32;
+		static constexpr std::size_t sub_buckets = 16;
+		static constexpr unsigned    max_exponent = 40;
+		static constexpr std::size_t bucket_count = linear_buckets + (max_exponent - 4) * sub_buckets;
+
+	public:
+		histogram();
+
+		static inline std::size_t bucket(uint64_t ns);
+		static uint64_t lower_bound(std::size_t bucket);
+		// exclusive
+		static uint64_t upper_bound(std::size_t bucket);
+
+		void record(uint64_t ns, uint64_t count = 1);
+		void merge(const histogram& other);
+
+		uint64_t count() const;
+		uint64_t min() const;
+		uint64_t max() const;
+		double mean() const;
+		// smallest recorded duration (up to bucket width) such that p percent
+		// of all durations are not longer, p in [0, 100]
+		uint64_t percentile(double p) const;
+		const std::vector<uint64_t>& buckets() const;
+
+	protected:
+		friend class profiling;
+
+		std::vector<uint64_t> buckets_;
+		uint64_t              count_;
+		uint64_t              min_;
+		uint64_t              max_;
+		double                sum_;
 };
 
 
+inline std::size_t profiling::histogram::bucket(uint64_t ns) {
+	if (ns < linear_buckets) return static_cast<std::size_t>(ns);
+	unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(ns));
+	if (exponent > max_exponent) return bucket_count - 1;
+	return linear_buckets + (exponent - 5) * sub_buckets + ((ns >> (exponent - 4)) & (sub_buckets - 1));
+}
+
+
+/**
+ *  Clock of all profiles, reading either std::chrono::steady_clock or the
+ *  invariant time stamp counter of x86 processors through rdtscp.
+ *
+ *  steady_clock costs a clock_gettime call, 20-50ns on common hosts,
+ *  which dominates timing regions of a few hundred nanoseconds, while
+ *  rdtscp costs around ten. The counter is calibrated against
+ *  steady_clock when the first profiling instance is created: both are
+ *  sampled over two short intervals, and the counter is only used if it
+ *  is invariant, its frequency is plausible and both intervals agree.
+ *  Times of either source are nanoseconds on the steady_clock time line,
+ *  so switching sources does not break running profiles. summarize()
+ *  checks for drift and falls back to steady_clock for good. The environment
+ *  variable DAMOGRAN_PROFILING_CLOCK (steady or tsc) selects the source
+ *  at startup, tsc is the default where usable.
+ */
+inline profiling::clock::time_point profiling::clock::now() {
+	if (source_.load(std::memory_order_acquire) == tsc) return time_point(duration(tsc_now()));
+	return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()));
+}
+
+/**
+ *  Times its own lifetime into a profile of the calling thread, nested
+ *  under the innermost profile open on that thread.
+ *
+ *  Construction and destruction cost one clock read each plus a short
+ *  scan of the current node's children; no allocation or name lookup
+ *  happens once the path has been recorded before. While profiling is
+ *  disabled they cost a branch each; instances passed as a function, like
+ *  profiling::global by DAMOGRAN_PROFILE_SCOPE, are then not even looked
+ *  up. Use through DAMOGRAN_PROFILE_SCOPE, which interns the name once per
+ *  call site.
+ *
+ *  Sampled scopes (DAMOGRAN_PROFILE_SCOPE_SAMPLED) count down a per-thread
+ *  countdown and time only every n-th pass, recorded with weight n:
+ *  call counts, times, histograms and counters are scaled by n, so totals
+ *  remain unbiased estimates as long as the scope is not in lockstep with
+ *  a period of the workload. Nothing is recorded during unsampled passes,
+ *  profiles nested in sampled passes are scaled by the product of the
+ *  periods of all sampled scopes around them, and sampled scopes nested in
+ *  unsampled passes keep their countdown. A period of 0 is taken as 1.
+ */
+class profiling::scope {
+	public:
+		scope(profiling& instance, id_t id) : buffer_(nullptr) {
+			if (enabled()) open(instance, id);
+		}
+
+		// instance is only called while profiling is enabled
+		scope(profiling& (*instance)(), id_t id) : buffer_(nullptr) {
+			if (enabled()) open(instance(), id);
+		}
+
+		scope(profiling& instance, id_t id, uint32_t period, uint32_t& countdown) : buffer_(nullptr) {
+			if (enabled()) open(instance, id, period, countdown);
+		}
+
+		scope(profiling& (*instance)(), id_t id, uint32_t period, uint32_t& countdown) : buffer_(nullptr) {
+			if (enabled()) open(instance(), id, period, countdown);
+		}
+
+		~scope() {
+			if (buffer_) close();
+		}
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+	protected:
+		// out of line, so the disabled path stays free of register
+		// spills; set depth_ and suppressing_ whenever buffer_ is set
+		void open(profiling& instance, id_t id);
+		void open(profiling& instance, id_t id, uint32_t period, uint32_t& countdown);
+		void close();
+
+		thread_buffer* buffer_;
+		std::size_t    depth_;
+		bool           suppressing_;
+};
+
+
+inline void profiling::thread_buffer::enter(id_t id, uint32_t period) {
+	uint32_t parent = stack.back().node;
+	uint32_t child = at(parent).first_child;
+	while (child != none && at(child).id != id) child = at(child).next_sibling;
+	if (child == none) child = append(parent, id);
+	node& entered = at(child);
+	entered.open.store(entered.open.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (counters_wanted.load(std::memory_order_relaxed) != counters_applied) update_counters();
+	bool counted = counters_applied && begin_counters(stack.size());
+	const uint64_t weight = stack.back().weight * period;
+	if (stack.size() == stack.capacity()) {
+		unaccounted pause;
+		stack.reserve(2 * stack.capacity());
+	}
+	stack.push_back(frame{child, clock_t::now(), weight, counted, live, live, allocating_});
+	allocating_ = this;
+}
+
+inline void profiling::thread_buffer::leave(time_point_t now) {
+	const frame& top = stack.back();
+	node& left = at(top.node);
+	const duration_t passed = now - top.start;
+	const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(passed).count());
+	left.inclusive.store(left.inclusive.load(std::memory_order_relaxed) + static_cast<rep_t>(top.weight) * passed.count(), std::memory_order_relaxed);
+	left.calls.store(left.calls.load(std::memory_order_relaxed) + top.weight, std::memory_order_relaxed);
+	std::atomic<uint64_t>& count = left.buckets[histogram::bucket(ns)];
+	count.store(count.load(std::memory_order_relaxed) + top.weight, std::memory_order_relaxed);
+	if (ns < left.min_ns.load(std::memory_order_relaxed)) left.min_ns.store(ns, std::memory_order_relaxed);
+	if (ns > left.max_ns.load(std::memory_order_relaxed)) left.max_ns.store(ns, std::memory_order_relaxed);
+	trace_ring* trace = ring.load(std::memory_order_acquire);
+	if (trace) trace->push(trace_event{left.id, top.start.time_since_epoch().count(), passed.count()});
+	if (top.counted) end_counters(left, stack.size() - 1, top.weight);
+	const int64_t live_peak = top.live_peak;
+	thread_buffer* const allocating = top.allocating;
+	if (static_cast<uint64_t>(live_peak - top.live_base) > left.peak_bytes.load(std::memory_order_relaxed)) {
+		left.peak_bytes.store(static_cast<uint64_t>(live_peak - top.live_base), std::memory_order_relaxed);
+	}
+	left.open.store(left.open.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	stack.pop_back();
+	if (live_peak > stack.back().live_peak) stack.back().live_peak = live_peak;
+	allocating_ = allocating;
+}
+
+inline void profiling::trace_ring::push(const trace_event& event) {
+	uint64_t h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) > mask) {
+		dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	}
+	events[h & mask] = event;
+	head.store(h + 1, std::memory_order_release);
+}
+
+inline profiling::thread_buffer* profiling::local(bool create) {
+	if (cached_serial_ == serial_) return cached_buffer_;
+	return lookup(create);
+}
+
+
 } // damogran
 
+#define DAMOGRAN_PROFILE_CONCAT_(a, b) a##b
+#define DAMOGRAN_PROFILE_CONCAT(a, b) DAMOGRAN_PROFILE_CONCAT_(a, b)
+
+/**
+ *  Profiles the rest of the enclosing scope as `name` in the given
+ *  profiling instance (DAMOGRAN_PROFILE_SCOPE_IN), which may also be a
+ *  function returning it, or in profiling::global()
+ *  (DAMOGRAN_PROFILE_SCOPE). The name is interned on
+ *  the first pass through the call site only. The _SAMPLED variants time
+ *  one in `period` passes per thread and scale the results accordingly,
+ *  for regions too hot to time every pass.
+ */
+#define DAMOGRAN_PROFILE_SCOPE_IN(instance, name) \
+	static const ::damogran::profiling::id_t DAMOGRAN_PROFILE_CONCAT(damogran_profile_id_, __LINE__) = ::damogran::profiling::id(name); \
+	::damogran::profiling::scope DAMOGRAN_PROFILE_CONCAT(damogran_profile_scope_, __LINE__)(instance, DAMOGRAN_PROFILE_CONCAT(damogran_profile_id_, __LINE__))
+
+#define DAMOGRAN_PROFILE_SCOPE_SAMPLED_IN(instance, name, period) \
+	static const ::damogran::profiling::id_t DAMOGRAN_PROFILE_CONCAT(damogran_profile_id_, __LINE__) = ::damogran::profiling::id(name); \
+	static thread_local uint32_t DAMOGRAN_PROFILE_CONCAT(damogran_profile_countdown_, __LINE__) = 1; \
+	::damogran::profiling::scope DAMOGRAN_PROFILE_CONCAT(damogran_profile_scope_, __LINE__)(instance, DAMOGRAN_PROFILE_CONCAT(damogran_profile_id_, __LINE__), period, DAMOGRAN_PROFILE_CONCAT(damogran_profile_countdown_, __LINE__))
+
+#define DAMOGRAN_PROFILE_SCOPE(name) DAMOGRAN_PROFILE_SCOPE_IN(::damogran::profiling::global, name)
+#define DAMOGRAN_PROFILE_SCOPE_SAMPLED(name, period) DAMOGRAN_PROFILE_SCOPE_SAMPLED_IN(::damogran::profiling::global, name, period)
+
 #endif // DAMOGRAN_PROFILING_H
@@ -0,0 +1,161 @@
+/*
+ * damogran - c++ opengl wrapper library
+ *
+ * Written in 2014 by Richard Vock
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright and related and neighboring rights to this software to the public domain worldwide.
+ * This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with this software.
+ * If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#ifndef DAMOGRAN_QRNG_HPP_
+#define DAMOGRAN_QRNG_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <istream>
+#include <stdexcept>
+#include <Eigen/Dense>
+
+#include "span.hpp"
+
+namespace damogran {
+
+
+// Low-discrepancy (quasi-random) point sequences in [0, 1)^dimensions.
+// Point i is a pure function of i, so seek() is O(1) and parallel fills give
+// the same points regardless of the number of threads.
+class quasi_sequence {
+	public:
+		typedef std::shared_ptr<quasi_sequence>       ptr;
+		typedef std::weak_ptr<quasi_sequence>         wptr;
+		typedef std::shared_ptr<const quasi_sequence> const_ptr;
+		typedef std::weak_ptr<const quasi_sequence>   const_wptr;
+
+	public:
+		virtual ~quasi_sequence();
+
+		uint32_t dimensions() const;
+		uint64_t position() const;
+		void seek(uint64_t index);
+
+		// Writes the point at position() to point (dimensions() values) and
+		// advances by one.
+		void next(float* point);
+
+		// Fills points (dimensions() values per point, point-major as in a
+		// column-major matrix with one point per column) with consecutive
+		// points starting at position() and advances past them.
+		void fill(span<float> points, unsigned int threads = 0);
+
+		// Fills every column of points; rows must equal dimensions().
+		template <int D>
+		void fill(Eigen::Matrix<float, D, Eigen::Dynamic>& points, unsigned int threads = 0);
+
+	protected:
+		explicit quasi_sequence(uint32_t dimensions);
+
+		// Writes points first, ..., first + count - 1.
+		virtual void generate(uint64_t first, std::size_t count, float* points) const = 0;
+
+	protected:
+		uint32_t dimensions_;
+		uint64_t position_;
+};
+
+
+// Sobol sequence in Gray code order with 32 bit direction numbers, i.e. the
+// first 2^32 points are distinct. Dimensions 1-21 use the direction numbers
+// of Joe and Kuo (new-joe-kuo-6.21201), higher dimensions use further
+// primitive polynomials with fixed pseudo-random initial direction numbers
+// unless a direction file in Joe and Kuo's format is given. A non-zero seed
+// applies a random digital shift (XOR) per dimension.
+class sobol_sequence : public quasi_sequence {
+	public:
+		typedef std::shared_ptr<sobol_sequence>       ptr;
+		typedef std::weak_ptr<sobol_sequence>         wptr;
+		typedef std::shared_ptr<const sobol_sequence> const_ptr;
+		typedef std::weak_ptr<const sobol_sequence>   const_wptr;
+
+	public:
+		explicit sobol_sequence(uint32_t dimensions, uint64_t seed = 0);
+		sobol_sequence(uint32_t dimensions, std::istream& direction_file, uint64_t seed = 0);
+		virtual ~sobol_sequence();
+
+	protected:
+		virtual void generate(uint64_t first, std::size_t count, float* points) const;
+		void init_shift(uint64_t seed);
+		uint32_t point_bits(uint32_t dimension, uint64_t index) const;
+
+	protected:
+		std::vector<uint32_t> directions_;   // 32 per dimension
+		std::vector<uint32_t> shift_;
+};
+
+
+// Halton sequence with the d-th prime as base of dimension d. A non-zero
+// seed scrambles the digits of every dimension with a random permutation
+// fixing 0 (Kocis and Whiten), which removes the correlation between high
+// dimensions of the plain sequence.
+class halton_sequence : public quasi_sequence {
+	public:
+		typedef std::shared_ptr<halton_sequence>       ptr;
+		typedef std::weak_ptr<halton_sequence>         wptr;
+		typedef std::shared_ptr<const halton_sequence> const_ptr;
+		typedef std::weak_ptr<const halton_sequence>   const_wptr;
+
+	public:
+		explicit halton_sequence(uint32_t dimensions, uint64_t seed = 0);
+		virtual ~halton_sequence();
+
+	protected:
+		virtual void generate(uint64_t first, std::size_t count, float* points) const;
+
+	protected:
+		std::vector<uint32_t> bases_;
+		std::vector<uint32_t> offsets_;        // start of each dimension's permutation
+		std::vector<uint16_t> permutations_;
+};
+
+
+// Roberts' R_d sequence: point i is frac(offset + i * alpha) with
+// alpha_j = phi_d^-(j + 1), phi_d the positive root of x^(d + 1) = x + 1.
+// Computed in 64 bit fixed point, so positions never lose precision. A
+// non-zero seed replaces the default offset 0.5 by a random one per
+// dimension.
+class rd_sequence : public quasi_sequence {
+	public:
+		typedef std::shared_ptr<rd_sequence>       ptr;
+		typedef std::weak_ptr<rd_sequence>         wptr;
+		typedef std::shared_ptr<const rd_sequence> const_ptr;
+		typedef std::weak_ptr<const rd_sequence>   const_wptr;
+
+	public:
+		explicit rd_sequence(uint32_t dimensions, uint64_t seed = 0);
+		virtual ~rd_sequence();
+
+	protected:
+		virtual void generate(uint64_t first, std::size_t count, float* points) const;
+
+	protected:
+		std::vector<uint64_t> alpha_;
+		std::vector<uint64_t> offset_;
+};
+
+
+template <int D>
+inline void quasi_sequence::fill(Eigen::Matrix<float, D, Eigen::Dynamic>& points, unsigned int threads) {
+	if (points.rows() != static_cast<int>(dimensions_)) {
+		throw std::runtime_error("quasi_sequence::fill: Matrix rows differ from sequence dimensions.");
+	}
+	fill(span<float>(points.data(), static_cast<std::size_t>(points.size())), threads);
+}
+
+
+} // damogran
+
+#endif /* DAMOGRAN_QRNG_HPP_ */
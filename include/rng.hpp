@@ -15,16 +15,43 @@
 #define DAMOGRAN_RNG_H_
 
 #include <random>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <iterator>
+#include <cstdint>
 #include <memory>
 #include <functional>
 #include <type_traits>
 
+#include "span.hpp"
+#include "parallel.hpp"
+#include "rng_engines.hpp"
 
 namespace damogran {
 
+namespace detail {
+
+// Marsaglia/Tsang ziggurat with 256 layers for a decreasing density f on
+// [0, inf). Layer i covers x in [0, x[i]] between heights f[i] and f[i + 1]
+// (f[i] = f(x[i])). x[0] is the width of a rectangle of height f(r) with the
+// area of the base layer including its tail beyond r = x[1].
+struct ziggurat {
+	double x[257];
+	double f[257];
+
+	static const ziggurat& normal();
+	static const ziggurat& exponential();
+};
+
+} // detail
+
 class rng {
 	public:
 		typedef std::mt19937 internal_generator_t;
+		typedef xoshiro256pp_x4 bulk_generator_t;
+		typedef philox4x32 stream_generator_t;
 
 		template <class T>
 		struct traits_t {
@@ -40,6 +67,30 @@ class rng {
 			typedef std::function<T ()> generator_t;
 		};
 
+		// Inline generator objects. Unlike the *_gen functions below they are
+		// concrete types the compiler can inline into sampling loops. Each owns
+		// its engine, by default a xoshiro256pp with 32 bytes of state, which
+		// must yield full 32 or 64 bit words. The *_gen functions wrap these
+		// around an internal_generator_t.
+		template <class T, class Engine = xoshiro256pp>
+		class uniform_01_engine;
+
+		template <class T, class Engine = xoshiro256pp>
+		class uniform_ab_engine;
+
+		template <class T, class Engine = xoshiro256pp>
+		class geometric_engine;
+
+		template <class T, class Engine = xoshiro256pp>
+		class normal_engine;
+
+		template <class T, class Engine = xoshiro256pp>
+		class exponential_engine;
+
+		// O(1) draws of indices i with probability weights[i] / sum(weights).
+		template <class T>
+		class alias_table;
+
 	public:
 		template <class T>
 		static T uniform_01();
@@ -53,6 +104,9 @@ class rng {
 		template <class T>
 		static T normal(T mean = 0.f, T std_dev = 1.f);
 
+		template <class T>
+		static T exponential(T lambda = 1.f);
+
 		template <class T>
 		static typename traits_t<T>::generator_t uniform_01_gen(bool deterministic = false);
 
@@ -65,10 +119,98 @@ class rng {
 		template <class T>
 		static typename traits_t<T>::generator_t normal_gen(T mean = 0.f, T std_dev = 1.f, bool deterministic = false);
 
+		template <class T>
+		static typename traits_t<T>::generator_t exponential_gen(T lambda = 1.f, bool deterministic = false);
+
+		// Uniform sample of min(k, length) items from a single pass over
+		// [first, last), in no particular order. Uses O(k log(n / k)) draws
+		// for a range of n items, so it suits streams of unknown length.
+		template <class InputIt, class Engine = xoshiro256pp>
+		static std::vector<typename std::iterator_traits<InputIt>::value_type> reservoir_sample(InputIt first, InputIt last, std::size_t k, Engine engine = make_engine<Engine>());
+
+		// Engine seeded from the thread's engine(), or default-constructed if
+		// deterministic.
+		template <class Engine>
+		static Engine make_engine(bool deterministic = false);
+
+		// Every thread owns one engine which all scalar draws (uniform_01,
+		// uniform_ab, geometric, normal) reuse. Unless seeded, engines start from
+		// std::random_device mixed with the thread's index.
+		static internal_generator_t& engine();
+
+		// Reseeds the engines of all threads from (seed, thread index) on their
+		// next draw. Thread indices are handed out in order of first use, so
+		// only the thread that drew first (usually the main thread) gets the
+		// same sequence in every run; threads of pools or parallel_chunks start
+		// in varying order. Use stream() or parallel_streams() for draws that
+		// have to be reproducible across threads.
+		static void seed(uint64_t seed);
+
+		// Reseeds the engine of the calling thread only.
+		static void seed_thread(uint64_t seed);
+
+		// Bulk fills. These draw from bulk_engine() (or the given engine) in
+		// blocks and are much faster per value than the scalar functions or
+		// *_gen generators. Ranges match the scalar functions: fill_uniform
+		// gives [a, b), fill_geometric the number of failures before the first
+		// success. fill_uniform_01 yields multiples of 2^-23 (float) or 2^-52
+		// (double). Engine is either bulk_generator_t or stream_generator_t.
+		template <class T>
+		static void fill_uniform(span<T> values, T a, T b);
+
+		template <class T, class Engine>
+		static void fill_uniform(Engine& engine, span<T> values, T a, T b);
+
+		template <class T>
+		static void fill_uniform_01(span<T> values);
+
+		template <class T, class Engine>
+		static void fill_uniform_01(Engine& engine, span<T> values);
+
+		template <class T>
+		static void fill_normal(span<T> values, T mean = 0.f, T std_dev = 1.f);
+
+		template <class T, class Engine>
+		static void fill_normal(Engine& engine, span<T> values, T mean = 0.f, T std_dev = 1.f);
+
+		template <class T>
+		static void fill_exponential(span<T> values, T lambda = 1.f);
+
+		template <class T, class Engine>
+		static void fill_exponential(Engine& engine, span<T> values, T lambda = 1.f);
+
+		template <class T>
+		static void fill_geometric(span<T> values, float p);
+
+		template <class T, class Engine>
+		static void fill_geometric(Engine& engine, span<T> values, float p);
+
+		// Per-thread engine used by the bulk fills. It is seeded from engine(),
+		// so rng::seed and rng::seed_thread apply to it as well.
+		static bulk_generator_t& bulk_engine();
+
+		// Counter-based stream: draw `offset` of stream `stream_id` under
+		// `seed`, independent of which thread asks for it and in what order.
+		static stream_generator_t stream(uint64_t seed, uint64_t stream_id, uint64_t offset = 0) {
+			return stream_generator_t(seed, stream_id, offset);
+		}
+
+		// Calls func(engine, begin, end) for chunks of [0, count) on up to
+		// `threads` threads, where engine is stream(seed, chunk index). Results
+		// depend on seed and chunk_size only, never on the number of threads.
+		template <class Func>
+		static void parallel_streams(std::size_t count, std::size_t chunk_size, uint64_t seed, Func&& func, unsigned int threads = 0) {
+			parallel_chunks(count, chunk_size, [&] (std::size_t chunk, std::size_t begin, std::size_t end) {
+				stream_generator_t engine(seed, chunk);
+				func(engine, begin, end);
+			}, threads);
+		}
+
 	protected:
 		static internal_generator_t generator(bool deterministic);
 };
 
+#include "rng.ipp"
 
 } // damogran
 
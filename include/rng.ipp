@@ -0,0 +1,284 @@
+namespace detail {
+
+// position within a ziggurat layer from the top 53 bits of a draw; the low
+// byte selects the layer and bit 8 the sign
+inline double ziggurat_position(uint64_t bits) {
+	// the shifted value fits int64_t, whose conversion is a single instruction
+	return double(int64_t(bits >> 11)) * (1.0 / 9007199254740992.0);
+}
+
+// +1 or -1 from bit 8, without a branch
+inline double ziggurat_sign(uint64_t bits) {
+	return 1.0 - double((bits >> 7) & 2);
+}
+
+// Completes a normal draw whose candidate missed its layer's rectangle:
+// tests the wedge (or samples the tail for the base layer) and starts over
+// with fresh bits on rejection.
+template <class Engine>
+inline double ziggurat_normal_slow(const ziggurat& z, Engine& engine, uint64_t bits) {
+	for (;;) {
+		unsigned int i = bits & 255;
+		double sign = ziggurat_sign(bits);
+		double x = ziggurat_position(bits) * z.x[i];
+		if (x < z.x[i + 1]) return sign * x;
+		if (i == 0) {
+			// Marsaglia's tail method
+			double r = z.x[1], t, y;
+			do {
+				t = -std::log(1.0 - unit(engine, double())) / r;
+				y = -std::log(1.0 - unit(engine, double()));
+			} while (y + y < t * t);
+			return sign * (r + t);
+		}
+		if (z.f[i] + (z.f[i + 1] - z.f[i]) * unit(engine, double()) < std::exp(-0.5 * x * x)) return sign * x;
+		bits = bits64(engine);
+	}
+}
+
+template <class Engine>
+inline double ziggurat_normal(const ziggurat& z, Engine& engine) {
+	uint64_t bits = bits64(engine);
+	double x = ziggurat_position(bits) * z.x[bits & 255];
+	if (x < z.x[(bits & 255) + 1]) return ziggurat_sign(bits) * x;
+	return ziggurat_normal_slow(z, engine, bits);
+}
+
+template <class Engine>
+inline double ziggurat_exponential_slow(const ziggurat& z, Engine& engine, uint64_t bits) {
+	for (;;) {
+		unsigned int i = bits & 255;
+		double x = ziggurat_position(bits) * z.x[i];
+		if (x < z.x[i + 1]) return x;
+		if (i == 0) {
+			// the tail beyond r is r plus another exponential variate
+			return z.x[1] - std::log(1.0 - unit(engine, double()));
+		}
+		if (z.f[i] + (z.f[i + 1] - z.f[i]) * unit(engine, double()) < std::exp(-x)) return x;
+		bits = bits64(engine);
+	}
+}
+
+template <class Engine>
+inline double ziggurat_exponential(const ziggurat& z, Engine& engine) {
+	uint64_t bits = bits64(engine);
+	double x = ziggurat_position(bits) * z.x[bits & 255];
+	if (x < z.x[(bits & 255) + 1]) return x;
+	return ziggurat_exponential_slow(z, engine, bits);
+}
+
+} // detail
+
+
+template <class Engine>
+inline Engine rng::make_engine(bool deterministic) {
+	if (deterministic) return Engine();
+	internal_generator_t& source = engine();
+	uint64_t high = source();
+	return Engine((high << 32) | uint32_t(source()));
+}
+
+
+template <class T, class Engine>
+class rng::uniform_01_engine {
+	public:
+		typedef T      result_type;
+		typedef Engine engine_type;
+
+	public:
+		explicit uniform_01_engine(Engine engine = make_engine<Engine>()) : engine_(engine) {}
+
+		T operator()() {
+			return detail::unit(engine_, T());
+		}
+
+		Engine& engine() { return engine_; }
+
+	protected:
+		Engine engine_;
+};
+
+
+// [a, b) like uniform_ab. Integral types use Lemire's multiply-shift with
+// rejection, which needs a division only when a draw lands in the biased
+// region.
+template <class T, class Engine>
+class rng::uniform_ab_engine {
+	public:
+		typedef T      result_type;
+		typedef Engine engine_type;
+
+	public:
+		uniform_ab_engine(T a, T b, Engine engine = make_engine<Engine>()) : engine_(engine), a_(a), range_(b - a) {
+			lower_ = int64_t(a);
+			width_ = int64_t(b) > lower_ ? uint32_t(int64_t(b) - lower_) : 0;
+			threshold_ = width_ ? uint32_t(0u - width_) % width_ : 0;
+		}
+
+		T operator()() {
+			return draw(std::is_floating_point<T>());
+		}
+
+		Engine& engine() { return engine_; }
+
+	protected:
+		T draw(std::true_type) {
+			return a_ + range_ * detail::unit(engine_, T());
+		}
+
+		T draw(std::false_type) {
+			uint64_t m = uint64_t(detail::bits32(engine_)) * width_;
+			if (uint32_t(m) < width_) {
+				while (uint32_t(m) < threshold_) {
+					m = uint64_t(detail::bits32(engine_)) * width_;
+				}
+			}
+			return static_cast<T>(lower_ + int64_t(m >> 32));
+		}
+
+	protected:
+		Engine   engine_;
+		T        a_;
+		T        range_;
+		int64_t  lower_;
+		uint32_t width_;
+		uint32_t threshold_;
+};
+
+
+// Number of failures before the first success, by inversion. Saturates at
+// the largest value of T. Engine may be a reference to share an engine.
+template <class T, class Engine>
+class rng::geometric_engine {
+	public:
+		typedef T      result_type;
+		typedef Engine engine_type;
+
+	public:
+		explicit geometric_engine(float p, Engine engine = make_engine<Engine>()) : engine_(engine), scale_(1.0 / std::log1p(-double(p))) {}
+
+		T operator()() {
+			// double(max()) rounds up for 64 bit types, hence the strict compare
+			double k = std::floor(std::log(1.0 - detail::unit(engine_, double())) * scale_);
+			return k < double(std::numeric_limits<T>::max()) ? static_cast<T>(k) : std::numeric_limits<T>::max();
+		}
+
+		Engine& engine() { return engine_; }
+
+	protected:
+		Engine engine_;
+		double scale_;
+};
+
+
+// Ziggurat (see detail::ziggurat), one 64 bit draw per value in about 99%
+// of all cases.
+template <class T, class Engine>
+class rng::normal_engine {
+	public:
+		typedef T      result_type;
+		typedef Engine engine_type;
+
+	public:
+		normal_engine(T mean = T(0), T std_dev = T(1), Engine engine = make_engine<Engine>()) : engine_(engine), table_(&detail::ziggurat::normal()), mean_(mean), std_dev_(std_dev) {}
+
+		T operator()() {
+			return mean_ + std_dev_ * T(detail::ziggurat_normal(*table_, engine_));
+		}
+
+		Engine& engine() { return engine_; }
+
+	protected:
+		Engine                   engine_;
+		const detail::ziggurat*  table_;
+		T                        mean_;
+		T                        std_dev_;
+};
+
+
+// Ziggurat as normal_engine, with rate lambda.
+template <class T, class Engine>
+class rng::exponential_engine {
+	public:
+		typedef T      result_type;
+		typedef Engine engine_type;
+
+	public:
+		explicit exponential_engine(T lambda = T(1), Engine engine = make_engine<Engine>()) : engine_(engine), table_(&detail::ziggurat::exponential()), scale_(T(1) / lambda) {}
+
+		T operator()() {
+			return scale_ * T(detail::ziggurat_exponential(*table_, engine_));
+		}
+
+		Engine& engine() { return engine_; }
+
+	protected:
+		Engine                   engine_;
+		const detail::ziggurat*  table_;
+		T                        scale_;
+};
+
+
+// Walker/Vose alias table over n weights: one 64 bit draw picks a column
+// (high half of draw * n) and decides between the column and its alias
+// (low half), so every draw costs O(1) and a single cache miss.
+template <class T>
+class rng::alias_table {
+	public:
+		typedef T weight_type;
+
+		struct entry {
+			T        threshold;   // keep the column if the coin is below
+			uint32_t alias;
+		};
+
+	public:
+		// Throws std::runtime_error if weights is empty, has more than 2^32
+		// entries, or holds negative/non-finite values or only zeros.
+		explicit alias_table(span<const T> weights);
+
+		std::size_t size() const { return table_.size(); }
+
+		template <class Engine>
+		uint32_t operator()(Engine& engine) const {
+			uint64_t low;
+			const uint64_t column_index = detail::multiply_high(detail::bits64(engine), table_.size(), low);
+			const entry& column = table_[column_index];
+			return detail::to_unit(low) < double(column.threshold) ? uint32_t(column_index) : column.alias;
+		}
+
+		// Fills out in parallel chunks drawing from rng::stream(seed, chunk);
+		// the result depends on seed only, not on the number of threads.
+		void draw(span<uint32_t> out, uint64_t seed, unsigned int threads = 0) const;
+
+		const std::vector<entry>& entries() const { return table_; }
+
+	protected:
+		std::vector<entry> table_;
+};
+
+
+template <class InputIt, class Engine>
+inline std::vector<typename std::iterator_traits<InputIt>::value_type> rng::reservoir_sample(InputIt first, InputIt last, std::size_t k, Engine engine) {
+	typedef typename std::iterator_traits<InputIt>::value_type value_type;
+	std::vector<value_type> reservoir;
+	if (!k) return reservoir;
+	reservoir.reserve(k);
+	for (; first != last && reservoir.size() < k; ++first) {
+		reservoir.push_back(*first);
+	}
+	if (first == last) return reservoir;
+
+	// Li's Algorithm L: the gap to the next replacement is geometric in the
+	// current threshold w, which shrinks by a Beta(k, 1) factor each time.
+	auto shrink = [&] () { return std::exp(std::log(1.0 - detail::unit(engine, double())) / double(k)); };
+	uniform_ab_engine<std::size_t, Engine&> slot(0, k, engine);
+	for (double w = shrink(); ; w *= shrink()) {
+		uint64_t skip = geometric_engine<uint64_t, Engine&>(float(w), engine)();
+		for (; skip && first != last; --skip) ++first;
+		if (first == last) break;
+		reservoir[slot()] = *first;
+		++first;
+	}
+	return reservoir;
+}
@@ -0,0 +1,357 @@
+/*
+ * damogran - c++ opengl wrapper library
+ *
+ * Written in 2014 by Richard Vock
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright and related and neighboring rights to this software to the public domain worldwide.
+ * This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with this software.
+ * If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#ifndef DAMOGRAN_RNG_ENGINES_HPP_
+#define DAMOGRAN_RNG_ENGINES_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+
+namespace damogran {
+
+
+inline uint64_t rotl64(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64 step, used to expand 64 bit seeds into full engine states.
+inline uint64_t splitmix64(uint64_t& state) {
+	uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+namespace detail {
+
+// [0, 1) from the top 23/52 bits placed into the mantissa of [1, 2)
+inline float to_unit(uint32_t x) {
+	uint32_t bits = (x >> 9) | 0x3f800000u;
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f - 1.f;
+}
+
+inline double to_unit(uint64_t x) {
+	uint64_t bits = (x >> 12) | 0x3ff0000000000000ull;
+	double d;
+	std::memcpy(&d, &bits, sizeof(d));
+	return d - 1.0;
+}
+
+// Full 128 bit product a * b, returning the high and storing the low word.
+// Compilers without a 128 bit integer type combine 32 bit partial products.
+inline uint64_t multiply_high(uint64_t a, uint64_t b, uint64_t& low) {
+#ifdef __SIZEOF_INT128__
+	__extension__ typedef unsigned __int128 wide_t;
+	wide_t product = static_cast<wide_t>(a) * b;
+	low = static_cast<uint64_t>(product);
+	return static_cast<uint64_t>(product >> 64);
+#else
+	const uint64_t a_low = uint32_t(a), a_high = a >> 32;
+	const uint64_t b_low = uint32_t(b), b_high = b >> 32;
+	const uint64_t ll = a_low * b_low;
+	const uint64_t lh = a_low * b_high;
+	const uint64_t hl = a_high * b_low;
+	const uint64_t hh = a_high * b_high;
+	const uint64_t middle = (ll >> 32) + uint32_t(lh) + uint32_t(hl);
+	low = (middle << 32) | uint32_t(ll);
+	return hh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+#endif
+}
+
+// Uniform bits from engines covering the full 32 or 64 bit range (mt19937,
+// the engines below).
+template <class Engine>
+inline uint32_t bits32(Engine& engine) {
+	static_assert(Engine::min() == 0 && (Engine::max() == 0xffffffffull || Engine::max() == ~0ull), "engine must yield full 32 or 64 bit words");
+	return Engine::max() == 0xffffffffull ? uint32_t(engine()) : uint32_t(uint64_t(engine()) >> 32);
+}
+
+template <class Engine>
+inline uint64_t bits64(Engine& engine) {
+	static_assert(Engine::min() == 0 && (Engine::max() == 0xffffffffull || Engine::max() == ~0ull), "engine must yield full 32 or 64 bit words");
+	if (Engine::max() == 0xffffffffull) {
+		uint64_t high = uint32_t(engine());
+		return (high << 32) | uint32_t(engine());
+	}
+	return engine();
+}
+
+template <class Engine>
+inline float unit(Engine& engine, float) {
+	return to_unit(bits32(engine));
+}
+
+template <class Engine>
+inline double unit(Engine& engine, double) {
+	return to_unit(bits64(engine));
+}
+
+} // detail
+
+
+// xoshiro256++ (Blackman/Vigna). Satisfies UniformRandomBitGenerator and can
+// therefore be used with the std:: distributions wherever mt19937 is used.
+class xoshiro256pp {
+	public:
+		typedef uint64_t result_type;
+
+	public:
+		explicit xoshiro256pp(uint64_t seed = 0) {
+			this->seed(seed);
+		}
+
+		void seed(uint64_t seed) {
+			for (int i = 0; i < 4; ++i) s_[i] = splitmix64(seed);
+		}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+		result_type operator()() {
+			const uint64_t result = rotl64(s_[0] + s_[3], 23) + s_[0];
+			const uint64_t t = s_[1] << 17;
+			s_[2] ^= s_[0];
+			s_[3] ^= s_[1];
+			s_[1] ^= s_[2];
+			s_[0] ^= s_[3];
+			s_[2] ^= t;
+			s_[3] = rotl64(s_[3], 45);
+			return result;
+		}
+
+		// Advances the state by 2^128 draws; successive jumps yield
+		// non-overlapping subsequences for parallel use.
+		void jump() {
+			static const uint64_t poly[4] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+			uint64_t t[4] = { 0, 0, 0, 0 };
+			for (int i = 0; i < 4; ++i) {
+				for (int b = 0; b < 64; ++b) {
+					if (poly[i] & (uint64_t(1) << b)) {
+						for (int j = 0; j < 4; ++j) t[j] ^= s_[j];
+					}
+					(*this)();
+				}
+			}
+			for (int j = 0; j < 4; ++j) s_[j] = t[j];
+		}
+
+		const uint64_t* state() const { return s_; }
+
+	protected:
+		uint64_t s_[4];
+};
+
+
+// Four xoshiro256++ engines, 2^128 draws apart, with their states stored
+// word-interleaved (state()[4 * word + lane]) so that one step of all lanes
+// maps onto a single 256 bit vector operation. Each step yields one draw
+// per lane, lane l landing at offset l.
+class xoshiro256pp_x4 {
+	public:
+		typedef uint64_t result_type;
+		static constexpr std::size_t lanes = 4;
+
+	public:
+		explicit xoshiro256pp_x4(uint64_t seed = 0) {
+			this->seed(seed);
+		}
+
+		void seed(uint64_t seed) {
+			xoshiro256pp lane(seed);
+			for (std::size_t l = 0; l < lanes; ++l) {
+				for (int w = 0; w < 4; ++w) s_[w * lanes + l] = lane.state()[w];
+				lane.jump();
+			}
+			next_ = lanes;
+		}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+		result_type operator()() {
+			if (next_ == lanes) {
+				step(s_, buffer_);
+				next_ = 0;
+			}
+			return buffer_[next_++];
+		}
+
+		// Writes n draws (n a multiple of lanes) to out by stepping all lanes
+		// n / lanes times. Draws buffered by operator() are left for later
+		// calls of operator().
+		void fill(uint64_t* out, std::size_t n) {
+			// stepping local copies keeps the state in registers, out could
+			// alias s_ otherwise
+			uint64_t s[4 * lanes];
+			std::copy(s_, s_ + 4 * lanes, s);
+			for (std::size_t i = 0; i < n; i += lanes) step(s, out + i);
+			std::copy(s, s + 4 * lanes, s_);
+		}
+
+		uint64_t* state() { return s_; }
+		const uint64_t* state() const { return s_; }
+
+	protected:
+		static void step(uint64_t* s, uint64_t* out) {
+			uint64_t* s0 = s;
+			uint64_t* s1 = s + lanes;
+			uint64_t* s2 = s + 2 * lanes;
+			uint64_t* s3 = s + 3 * lanes;
+			for (std::size_t l = 0; l < lanes; ++l) {
+				out[l] = rotl64(s0[l] + s3[l], 23) + s0[l];
+				const uint64_t t = s1[l] << 17;
+				s2[l] ^= s0[l];
+				s3[l] ^= s1[l];
+				s1[l] ^= s2[l];
+				s0[l] ^= s3[l];
+				s2[l] ^= t;
+				s3[l] = rotl64(s3[l], 45);
+			}
+		}
+
+	protected:
+		uint64_t    s_[4 * lanes];
+		uint64_t    buffer_[lanes];
+		std::size_t next_;
+};
+
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"). A counter-based engine: draw `offset` of stream `stream` under key
+// `seed` is a pure function of the three, so any position of any stream can
+// be reached in O(1) through seek(). Every counter yields two 64 bit draws.
+class philox4x32 {
+	public:
+		typedef uint64_t result_type;
+		// blocks computed side by side in fill()
+		static constexpr std::size_t batch = 8;
+
+	public:
+		explicit philox4x32(uint64_t seed = 0, uint64_t stream = 0, uint64_t offset = 0) : seed_(seed), stream_(stream) {
+			seek(offset);
+		}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+		uint64_t seed() const { return seed_; }
+		uint64_t stream() const { return stream_; }
+		// index of the next draw within the stream
+		uint64_t offset() const { return 2 * block_ - (2 - next_); }
+
+		void seek(uint64_t offset) {
+			block_ = offset / 2;
+			next_ = 2;
+			if (offset % 2) {
+				next_block(buffer_);
+				next_ = 1;
+			}
+		}
+
+		void discard(uint64_t count) {
+			seek(offset() + count);
+		}
+
+		result_type operator()() {
+			if (next_ == 2) {
+				next_block(buffer_);
+				next_ = 0;
+			}
+			return buffer_[next_++];
+		}
+
+		// Writes the next n draws to out.
+		void fill(uint64_t* out, std::size_t n) {
+			std::size_t i = 0;
+			for (; i < n && next_ < 2; ++i) out[i] = buffer_[next_++];
+			uint32_t c[4][batch];
+			for (; i + 2 * batch <= n; i += 2 * batch) {
+				for (std::size_t b = 0; b < batch; ++b) set_counter(c, b, block_ + b);
+				rounds(c);
+				for (std::size_t b = 0; b < batch; ++b) {
+					out[i + 2 * b]     = c[0][b] | (uint64_t(c[1][b]) << 32);
+					out[i + 2 * b + 1] = c[2][b] | (uint64_t(c[3][b]) << 32);
+				}
+				block_ += batch;
+			}
+			for (; i < n; ++i) out[i] = (*this)();
+		}
+
+		// Raw Philox4x32-10 block function on one counter.
+		static void block(const uint32_t counter[4], uint32_t key0, uint32_t key1, uint32_t result[4]) {
+			uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+			for (int r = 0; r < 10; ++r) {
+				round(c0, c1, c2, c3, key0, key1);
+				key0 += 0x9e3779b9u;
+				key1 += 0xbb67ae85u;
+			}
+			result[0] = c0; result[1] = c1; result[2] = c2; result[3] = c3;
+		}
+
+	protected:
+		static void round(uint32_t& c0, uint32_t& c1, uint32_t& c2, uint32_t& c3, uint32_t k0, uint32_t k1) {
+			const uint64_t p0 = uint64_t(0xd2511f53u) * c0;
+			const uint64_t p1 = uint64_t(0xcd9e8d57u) * c2;
+			const uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+			const uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+			c0 = n0;
+			c1 = uint32_t(p1);
+			c2 = n2;
+			c3 = uint32_t(p0);
+		}
+
+		void set_counter(uint32_t c[4][batch], std::size_t b, uint64_t block) const {
+			c[0][b] = uint32_t(block);
+			c[1][b] = uint32_t(block >> 32);
+			c[2][b] = uint32_t(stream_);
+			c[3][b] = uint32_t(stream_ >> 32);
+		}
+
+		// ten rounds over batch counters in SoA layout, vectorizable lane-wise
+		void rounds(uint32_t c[4][batch]) const {
+			uint32_t k0 = uint32_t(seed_), k1 = uint32_t(seed_ >> 32);
+			for (int r = 0; r < 10; ++r) {
+				for (std::size_t b = 0; b < batch; ++b) {
+					round(c[0][b], c[1][b], c[2][b], c[3][b], k0, k1);
+				}
+				k0 += 0x9e3779b9u;
+				k1 += 0xbb67ae85u;
+			}
+		}
+
+		void next_block(uint64_t out[2]) {
+			uint32_t c[4] = { uint32_t(block_), uint32_t(block_ >> 32), uint32_t(stream_), uint32_t(stream_ >> 32) };
+			uint32_t x[4];
+			block(c, uint32_t(seed_), uint32_t(seed_ >> 32), x);
+			out[0] = x[0] | (uint64_t(x[1]) << 32);
+			out[1] = x[2] | (uint64_t(x[3]) << 32);
+			++block_;
+		}
+
+	protected:
+		uint64_t    seed_;
+		uint64_t    stream_;
+		uint64_t    block_;   // next counter to compute
+		uint64_t    buffer_[2];
+		std::size_t next_;
+};
+
+
+} // damogran
+
+#endif /* DAMOGRAN_RNG_ENGINES_HPP_ */
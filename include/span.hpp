@@ -0,0 +1,50 @@
+#ifndef DAMOGRAN_SPAN_HPP_
+#define DAMOGRAN_SPAN_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+namespace damogran {
+
+template <typename T>
+class span {
+	public:
+		typedef T element_type;
+		typedef typename std::remove_cv<T>::type value_type;
+		typedef std::size_t size_type;
+		typedef T* iterator;
+
+	public:
+		span() : data_(nullptr), size_(0) {}
+		span(T* data, size_type size) : data_(data), size_(size) {}
+
+		template <typename U, typename = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+		span(const span<U>& other) : data_(other.data()), size_(other.size()) {}
+
+		template <typename Alloc>
+		span(std::vector<value_type, Alloc>& vec) : data_(vec.data()), size_(vec.size()) {}
+
+		template <typename Alloc, typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+		span(const std::vector<value_type, Alloc>& vec) : data_(vec.data()), size_(vec.size()) {}
+
+		T* data() const { return data_; }
+		size_type size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+
+		T& operator[](size_type i) const { return data_[i]; }
+
+		iterator begin() const { return data_; }
+		iterator end()   const { return data_ + size_; }
+
+		span subspan(size_type offset, size_type count) const { return span(data_ + offset, count); }
+
+	protected:
+		T*        data_;
+		size_type size_;
+};
+
+
+} // damogran
+
+#endif /* DAMOGRAN_SPAN_HPP_ */
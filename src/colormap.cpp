@@ -0,0 +1,157 @@
+/*
+ * damogran - c++ opengl wrapper library
+ *
+ * Written in 2014 by Richard Vock
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright and related and neighboring rights to this software to the public domain worldwide.
+ * This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with this software.
+ * If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#include <colormap.hpp>
+#include <macros.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace damogran {
+
+
+namespace {
+
+constexpr std::size_t index_block = 1024;
+
+} // anonymous
+
+template <class ColorType>
+colormap<ColorType>::colormap(const std::vector<color_type>& stops, float lower, float upper, uint32_t resolution) : colormap(lower, upper) {
+	std::vector<stop_type> positioned;
+	for (std::size_t i = 0; i < stops.size(); ++i) {
+		float t = stops.size() > 1 ? static_cast<float>(i) / static_cast<float>(stops.size() - 1) : 0.f;
+		positioned.push_back(stop_type(t, stops[i]));
+	}
+	sample(positioned, resolution);
+}
+
+template <class ColorType>
+colormap<ColorType>::colormap(const std::vector<stop_type>& stops, float lower, float upper, uint32_t resolution) : colormap(lower, upper) {
+	sample(stops, resolution);
+}
+
+template <class ColorType>
+colormap<ColorType>::colormap(float lower, float upper) : lower_(lower), upper_(upper), scale_(0.f), offset_(0.f) {
+	if (!(upper > lower)) {
+		throw std::runtime_error("colormap: Upper bound must be greater than lower bound.");
+	}
+}
+
+template <class ColorType>
+colormap<ColorType>::~colormap() {
+}
+
+template <class ColorType>
+colormap<ColorType> colormap<ColorType>::discrete(const std::vector<color_type>& palette, float lower, float upper) {
+	if (palette.empty()) {
+		throw std::runtime_error("colormap::discrete: Empty palette.");
+	}
+	colormap result(lower, upper);
+	result.table_.assign(palette.begin(), palette.end());
+	// bins: index = floor(t * size)
+	result.scale_ = static_cast<float>(palette.size()) / (upper - lower);
+	result.offset_ = 0.f;
+	return result;
+}
+
+template <class ColorType>
+float colormap<ColorType>::lower() const {
+	return lower_;
+}
+
+template <class ColorType>
+float colormap<ColorType>::upper() const {
+	return upper_;
+}
+
+template <class ColorType>
+const typename colormap<ColorType>::table_type& colormap<ColorType>::table() const {
+	return table_;
+}
+
+template <class ColorType>
+typename colormap<ColorType>::color_type colormap<ColorType>::operator()(float value) const {
+	color_type result;
+	map(span<const float>(&value, 1), span<color_type>(&result, 1));
+	return result;
+}
+
+template <class ColorType>
+void colormap<ColorType>::map(span<const float> values, span<color_type> output) const {
+	if (values.size() != output.size()) {
+		throw std::runtime_error("colormap::map: Input and output spans differ in size.");
+	}
+	const float max_index = static_cast<float>(table_.size() - 1);
+	int32_t indices[index_block];
+	for (std::size_t offset = 0; offset < values.size(); offset += index_block) {
+		std::size_t n = std::min(index_block, values.size() - offset);
+		const float* in = values.data() + offset;
+		// branch free so the compiler vectorizes it; NaN ends up at 0
+		for (std::size_t i = 0; i < n; ++i) {
+			float x = (in[i] - lower_) * scale_ + offset_;
+			x = x > 0.f ? x : 0.f;
+			x = x < max_index ? x : max_index;
+			indices[i] = static_cast<int32_t>(x);
+		}
+		color_type* out = output.data() + offset;
+		for (std::size_t i = 0; i < n; ++i) {
+			out[i] = table_[indices[i]];
+		}
+	}
+}
+
+template <class ColorType>
+void colormap<ColorType>::sample(const std::vector<stop_type>& stops, uint32_t resolution) {
+	if (stops.empty() || !resolution) {
+		throw std::runtime_error("colormap: Need at least one stop and a positive resolution.");
+	}
+	for (std::size_t i = 1; i < stops.size(); ++i) {
+		if (stops[i].first < stops[i-1].first) {
+			throw std::runtime_error("colormap: Stop positions must be ascending.");
+		}
+	}
+
+	table_.resize(resolution);
+	for (uint32_t i = 0; i < resolution; ++i) {
+		float t = resolution > 1 ? static_cast<float>(i) / static_cast<float>(resolution - 1) : 0.f;
+		auto next = std::upper_bound(stops.begin(), stops.end(), t, [] (float value, const stop_type& stop) { return value < stop.first; });
+		if (next == stops.begin()) {
+			table_[i] = stops.front().second;
+		} else if (next == stops.end()) {
+			table_[i] = stops.back().second;
+		} else {
+			const stop_type& prev = *(next - 1);
+			float w = (t - prev.first) / (next->first - prev.first);
+			for (int c = 0; c < color_type::RowsAtCompileTime; ++c) {
+				float x = (1.f - w) * static_cast<float>(prev.second[c]) + w * static_cast<float>(next->second[c]);
+				table_[i][c] = static_cast<scalar_type>(std::is_integral<scalar_type>::value ? std::round(x) : x);
+			}
+		}
+	}
+	// table entry i sits at t = i / (resolution - 1); round to the nearest one
+	scale_ = static_cast<float>(resolution - 1) / (upper_ - lower_);
+	offset_ = 0.5f;
+}
+
+
+#define X(type) \
+	template class colormap<RGB<type>>; \
+	template class colormap<RGBA<type>>; \
+	template class colormap<HSV<type>>; \
+	template class colormap<HSVA<type>>;
+COLOR_SCALAR_TYPES
+#undef X
+
+
+} // damogran
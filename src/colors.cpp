@@ -14,8 +14,16 @@
 #include <colors.hpp>
 
 #include <rng.hpp>
+#include <parallel.hpp>
+#include <macros.hpp>
 
-#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DAMOGRAN_COLORS_X86
+#endif
 
 namespace damogran {
 
@@ -37,7 +45,7 @@ struct color_limits_t<double> {
 template <>
 struct color_limits_t<short> {
 	static constexpr short lower = 0;
-	static constexpr short upper = 65535;
+	static constexpr short upper = 32767;
 	static constexpr float rnd_upper = 1.f;
 };
 
@@ -65,16 +73,608 @@ struct color_limits_t<char> {
 	static constexpr char upper = 127;
 };
 
+namespace detail {
+
+constexpr float sector_width = static_cast<float>(M_PI) / 3.f;
+constexpr float full_circle = static_cast<float>(M_PI) * 2.f;
+constexpr std::size_t lane_block = 256;
+constexpr std::size_t palette_chunk = 4096;
+constexpr std::size_t query_chunk = 1024;
+constexpr uint32_t leaf_size = 8;
+
+// Hue is kept in radians for floating point scalars. Integral scalars map
+// the full circle onto [lower, upper] instead, so normalized integral hues
+// are scaled by 2pi before entering the (radian based) lane functions.
 template <typename Scalar>
-RGB<Scalar>::RGB() : col_vec3_t<Scalar>() {
+constexpr float hue_scale() {
+	return std::is_floating_point<Scalar>::value ? 1.f : full_circle;
 }
 
+// exclusive upper bound of hue values
 template <typename Scalar>
-RGB<Scalar>::RGB(Scalar r, Scalar g, Scalar b) : col_vec3_t<Scalar>(r,g,b) {
+constexpr Scalar hue_upper() {
+	return std::is_floating_point<Scalar>::value ? static_cast<Scalar>(full_circle) : color_limits_t<Scalar>::upper;
+}
+
+// channel order per hue sector, indexing {v, p, q, t}
+constexpr int sector_channels[6][3] = {
+	{0, 3, 1}, {2, 0, 1}, {1, 0, 3}, {1, 2, 0}, {3, 1, 0}, {0, 1, 2}
+};
+
+// Single lane conversions on normalized values. These are the reference
+// the vectorized kernels below have to reproduce bit by bit.
+inline void hsv_to_rgb(float h, float s, float v, float& r, float& g, float& b) {
+	float a = h / sector_width;
+	float c = std::floor(a);
+	float f = a - c;
+	float channels[4] = {
+		v,
+		v * (1.f - s),
+		v * (1.f - s * f),
+		v * (1.f - s * (1.f - f))
+	};
+	// sector 6 (h == 2pi) and out of range hues map to sector 0
+	int sector = (c >= 1.f && c <= 5.f) ? static_cast<int>(c) : 0;
+	r = channels[sector_channels[sector][0]];
+	g = channels[sector_channels[sector][1]];
+	b = channels[sector_channels[sector][2]];
+}
+
+inline void rgb_to_hsv(float r, float g, float b, float& h, float& s, float& v) {
+	float min = std::min(std::min(r, g), b);
+	float max = std::max(std::max(r, g), b);
+	float d = max - min;
+	float h_r = sector_width * ((g - b) / d);
+	float h_g = sector_width * (2.f + (b - r) / d);
+	float h_b = sector_width * (4.f + (r - g) / d);
+	h = min == max ? 0.f : (max == r ? h_r : (max == g ? h_g : h_b));
+	h = h < 0.f ? h + full_circle : h;
+	s = max == 0.f ? 0.f : d / max;
+	v = max;
+}
+
+// Kernels work in-place on SoA lanes: (x, y, z) hold the source channels on
+// input and the target channels on output.
+typedef void (*lane_kernel_t)(float* x, float* y, float* z, std::size_t n);
+
+void hsv_to_rgb_scalar(float* x, float* y, float* z, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		hsv_to_rgb(x[i], y[i], z[i], x[i], y[i], z[i]);
+	}
+}
+
+void rgb_to_hsv_scalar(float* x, float* y, float* z, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		rgb_to_hsv(x[i], y[i], z[i], x[i], y[i], z[i]);
+	}
+}
+
+#ifdef DAMOGRAN_COLORS_X86
+
+// Note that std::min(a, b) == _mm_min_ps(b, a) and std::max(a, b) == _mm_max_ps(b, a)
+// with respect to NaN and signed zero handling.
+
+inline __m128 select_sse2(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128 floor_sse2(__m128 a) {
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+	t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.f)));
+	// |a| >= 2^23 (and NaN) is integral already and would overflow the int conversion
+	__m128 small = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), a), _mm_set1_ps(8388608.f));
+	return select_sse2(small, t, a);
+}
+
+void hsv_to_rgb_sse2(float* x, float* y, float* z, std::size_t n) {
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 width = _mm_set1_ps(sector_width);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 h = _mm_loadu_ps(x + i);
+		__m128 s = _mm_loadu_ps(y + i);
+		__m128 v = _mm_loadu_ps(z + i);
+		__m128 a = _mm_div_ps(h, width);
+		__m128 c = floor_sse2(a);
+		__m128 f = _mm_sub_ps(a, c);
+		__m128 p = _mm_mul_ps(v, _mm_sub_ps(one, s));
+		__m128 q = _mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(s, f)));
+		__m128 t = _mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(s, _mm_sub_ps(one, f))));
+
+		__m128 r = v, g = t, b = p;
+		__m128 m = _mm_cmpeq_ps(c, _mm_set1_ps(1.f));
+		r = select_sse2(m, q, r); g = select_sse2(m, v, g);
+		m = _mm_cmpeq_ps(c, _mm_set1_ps(2.f));
+		r = select_sse2(m, p, r); g = select_sse2(m, v, g); b = select_sse2(m, t, b);
+		m = _mm_cmpeq_ps(c, _mm_set1_ps(3.f));
+		r = select_sse2(m, p, r); g = select_sse2(m, q, g); b = select_sse2(m, v, b);
+		m = _mm_cmpeq_ps(c, _mm_set1_ps(4.f));
+		r = select_sse2(m, t, r); g = select_sse2(m, p, g); b = select_sse2(m, v, b);
+		m = _mm_cmpeq_ps(c, _mm_set1_ps(5.f));
+		g = select_sse2(m, p, g); b = select_sse2(m, q, b);
+
+		_mm_storeu_ps(x + i, r);
+		_mm_storeu_ps(y + i, g);
+		_mm_storeu_ps(z + i, b);
+	}
+	hsv_to_rgb_scalar(x + i, y + i, z + i, n - i);
+}
+
+void rgb_to_hsv_sse2(float* x, float* y, float* z, std::size_t n) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 width = _mm_set1_ps(sector_width);
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 r = _mm_loadu_ps(x + i);
+		__m128 g = _mm_loadu_ps(y + i);
+		__m128 b = _mm_loadu_ps(z + i);
+		__m128 min = _mm_min_ps(b, _mm_min_ps(g, r));
+		__m128 max = _mm_max_ps(b, _mm_max_ps(g, r));
+		__m128 d = _mm_sub_ps(max, min);
+		__m128 h_r = _mm_mul_ps(width, _mm_div_ps(_mm_sub_ps(g, b), d));
+		__m128 h_g = _mm_mul_ps(width, _mm_add_ps(_mm_set1_ps(2.f), _mm_div_ps(_mm_sub_ps(b, r), d)));
+		__m128 h_b = _mm_mul_ps(width, _mm_add_ps(_mm_set1_ps(4.f), _mm_div_ps(_mm_sub_ps(r, g), d)));
+		__m128 h = select_sse2(_mm_cmpeq_ps(max, g), h_g, h_b);
+		h = select_sse2(_mm_cmpeq_ps(max, r), h_r, h);
+		h = select_sse2(_mm_cmpeq_ps(min, max), zero, h);
+		h = select_sse2(_mm_cmplt_ps(h, zero), _mm_add_ps(h, _mm_set1_ps(full_circle)), h);
+		__m128 s = select_sse2(_mm_cmpeq_ps(max, zero), zero, _mm_div_ps(d, max));
+
+		_mm_storeu_ps(x + i, h);
+		_mm_storeu_ps(y + i, s);
+		_mm_storeu_ps(z + i, max);
+	}
+	rgb_to_hsv_scalar(x + i, y + i, z + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void hsv_to_rgb_avx2(float* x, float* y, float* z, std::size_t n) {
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 width = _mm256_set1_ps(sector_width);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 h = _mm256_loadu_ps(x + i);
+		__m256 s = _mm256_loadu_ps(y + i);
+		__m256 v = _mm256_loadu_ps(z + i);
+		__m256 a = _mm256_div_ps(h, width);
+		__m256 c = _mm256_floor_ps(a);
+		__m256 f = _mm256_sub_ps(a, c);
+		__m256 p = _mm256_mul_ps(v, _mm256_sub_ps(one, s));
+		__m256 q = _mm256_mul_ps(v, _mm256_sub_ps(one, _mm256_mul_ps(s, f)));
+		__m256 t = _mm256_mul_ps(v, _mm256_sub_ps(one, _mm256_mul_ps(s, _mm256_sub_ps(one, f))));
+
+		__m256 r = v, g = t, b = p;
+		__m256 m = _mm256_cmp_ps(c, _mm256_set1_ps(1.f), _CMP_EQ_OQ);
+		r = _mm256_blendv_ps(r, q, m); g = _mm256_blendv_ps(g, v, m);
+		m = _mm256_cmp_ps(c, _mm256_set1_ps(2.f), _CMP_EQ_OQ);
+		r = _mm256_blendv_ps(r, p, m); g = _mm256_blendv_ps(g, v, m); b = _mm256_blendv_ps(b, t, m);
+		m = _mm256_cmp_ps(c, _mm256_set1_ps(3.f), _CMP_EQ_OQ);
+		r = _mm256_blendv_ps(r, p, m); g = _mm256_blendv_ps(g, q, m); b = _mm256_blendv_ps(b, v, m);
+		m = _mm256_cmp_ps(c, _mm256_set1_ps(4.f), _CMP_EQ_OQ);
+		r = _mm256_blendv_ps(r, t, m); g = _mm256_blendv_ps(g, p, m); b = _mm256_blendv_ps(b, v, m);
+		m = _mm256_cmp_ps(c, _mm256_set1_ps(5.f), _CMP_EQ_OQ);
+		g = _mm256_blendv_ps(g, p, m); b = _mm256_blendv_ps(b, q, m);
+
+		_mm256_storeu_ps(x + i, r);
+		_mm256_storeu_ps(y + i, g);
+		_mm256_storeu_ps(z + i, b);
+	}
+	hsv_to_rgb_sse2(x + i, y + i, z + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void rgb_to_hsv_avx2(float* x, float* y, float* z, std::size_t n) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 width = _mm256_set1_ps(sector_width);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 r = _mm256_loadu_ps(x + i);
+		__m256 g = _mm256_loadu_ps(y + i);
+		__m256 b = _mm256_loadu_ps(z + i);
+		__m256 min = _mm256_min_ps(b, _mm256_min_ps(g, r));
+		__m256 max = _mm256_max_ps(b, _mm256_max_ps(g, r));
+		__m256 d = _mm256_sub_ps(max, min);
+		__m256 h_r = _mm256_mul_ps(width, _mm256_div_ps(_mm256_sub_ps(g, b), d));
+		__m256 h_g = _mm256_mul_ps(width, _mm256_add_ps(_mm256_set1_ps(2.f), _mm256_div_ps(_mm256_sub_ps(b, r), d)));
+		__m256 h_b = _mm256_mul_ps(width, _mm256_add_ps(_mm256_set1_ps(4.f), _mm256_div_ps(_mm256_sub_ps(r, g), d)));
+		__m256 h = _mm256_blendv_ps(h_b, h_g, _mm256_cmp_ps(max, g, _CMP_EQ_OQ));
+		h = _mm256_blendv_ps(h, h_r, _mm256_cmp_ps(max, r, _CMP_EQ_OQ));
+		h = _mm256_blendv_ps(h, zero, _mm256_cmp_ps(min, max, _CMP_EQ_OQ));
+		h = _mm256_blendv_ps(h, _mm256_add_ps(h, _mm256_set1_ps(full_circle)), _mm256_cmp_ps(h, zero, _CMP_LT_OQ));
+		__m256 s = _mm256_blendv_ps(_mm256_div_ps(d, max), zero, _mm256_cmp_ps(max, zero, _CMP_EQ_OQ));
+
+		_mm256_storeu_ps(x + i, h);
+		_mm256_storeu_ps(y + i, s);
+		_mm256_storeu_ps(z + i, max);
+	}
+	rgb_to_hsv_sse2(x + i, y + i, z + i, n - i);
+}
+
+#endif // DAMOGRAN_COLORS_X86
+
+lane_kernel_t hsv_to_rgb_kernel() {
+#ifdef DAMOGRAN_COLORS_X86
+	static const lane_kernel_t kernel = __builtin_cpu_supports("avx2") ? &hsv_to_rgb_avx2 : &hsv_to_rgb_sse2;
+	return kernel;
+#else
+	return &hsv_to_rgb_scalar;
+#endif
+}
+
+lane_kernel_t rgb_to_hsv_kernel() {
+#ifdef DAMOGRAN_COLORS_X86
+	static const lane_kernel_t kernel = __builtin_cpu_supports("avx2") ? &rgb_to_hsv_avx2 : &rgb_to_hsv_sse2;
+	return kernel;
+#else
+	return &rgb_to_hsv_scalar;
+#endif
+}
+
+template <class ColorType> struct color_traits;
+
+template <typename Scalar>
+struct color_traits<RGB<Scalar>> {
+	static constexpr bool is_hsv = false;
+	static constexpr bool has_alpha = false;
+};
+
+template <typename Scalar>
+struct color_traits<RGBA<Scalar>> {
+	static constexpr bool is_hsv = false;
+	static constexpr bool has_alpha = true;
+};
+
+template <typename Scalar>
+struct color_traits<HSV<Scalar>> {
+	static constexpr bool is_hsv = true;
+	static constexpr bool has_alpha = false;
+};
+
+template <typename Scalar>
+struct color_traits<HSVA<Scalar>> {
+	static constexpr bool is_hsv = true;
+	static constexpr bool has_alpha = true;
+};
+
+template <class C> inline const C& load(const span<const C>& s, std::size_t i) { return s[i]; }
+template <class C> inline C load(const packed_color_view<const C>& v, std::size_t i) { return v.get(i); }
+template <class C> inline void store(const span<C>& s, std::size_t i, const C& c) { s[i] = c; }
+template <class C> inline void store(const packed_color_view<C>& v, std::size_t i, const C& c) { v.set(i, c); }
+
+template <class TargetType, class SourceType, bool SameSpace = color_traits<TargetType>::is_hsv == color_traits<SourceType>::is_hsv>
+struct batch_convert {
+	// same color space; only channel count differs
+	template <class Input, class Output>
+	static void run(const Input& input, const Output& output) {
+		for (std::size_t i = 0; i < input.size(); ++i) {
+			store(output, i, TargetType(load(input, i)));
+		}
+	}
+};
+
+template <class TargetType, class SourceType>
+struct batch_convert<TargetType, SourceType, false> {
+	typedef typename SourceType::scalar_type scalar_type;
+	typedef std::integral_constant<bool, color_traits<SourceType>::has_alpha> source_alpha;
+	typedef std::integral_constant<bool, color_traits<TargetType>::has_alpha> target_alpha;
+
+	template <class Input, class Output>
+	static void run(const Input& input, const Output& output) {
+		const float lower = static_cast<float>(color_limits_t<scalar_type>::lower);
+		const float range = static_cast<float>(color_limits_t<scalar_type>::upper - color_limits_t<scalar_type>::lower);
+		lane_kernel_t kernel = color_traits<SourceType>::is_hsv ? hsv_to_rgb_kernel() : rgb_to_hsv_kernel();
+
+		alignas(32) float x[lane_block];
+		alignas(32) float y[lane_block];
+		alignas(32) float z[lane_block];
+		scalar_type a[lane_block];
+		for (std::size_t offset = 0; offset < input.size(); offset += lane_block) {
+			std::size_t n = std::min(lane_block, input.size() - offset);
+			for (std::size_t i = 0; i < n; ++i) {
+				const SourceType& in = load(input, offset + i);
+				x[i] = (static_cast<float>(in[0]) - lower) / range;
+				if (color_traits<SourceType>::is_hsv) x[i] *= hue_scale<scalar_type>();
+				y[i] = (static_cast<float>(in[1]) - lower) / range;
+				z[i] = (static_cast<float>(in[2]) - lower) / range;
+				a[i] = alpha(in, source_alpha());
+			}
+			kernel(x, y, z, n);
+			for (std::size_t i = 0; i < n; ++i) {
+				if (color_traits<TargetType>::is_hsv) x[i] /= hue_scale<scalar_type>();
+				TargetType out;
+				out[0] = scalar_type(x[i] * range + lower);
+				out[1] = scalar_type(y[i] * range + lower);
+				out[2] = scalar_type(z[i] * range + lower);
+				set_alpha(out, a[i], target_alpha());
+				store(output, offset + i, out);
+			}
+		}
+	}
+
+	static scalar_type alpha(const SourceType& color, std::true_type) { return color[3]; }
+	static scalar_type alpha(const SourceType&, std::false_type) { return scalar_type(1); }
+
+	static void set_alpha(TargetType& color, scalar_type a, std::true_type) { color[3] = a; }
+	static void set_alpha(TargetType&, scalar_type, std::false_type) { }
+};
+
+// Table driven conversions for integral scalars. Hue sectors and
+// fractions are tabulated per hue value, divisions by a channel value use
+// ceil(2^47 / x) reciprocal tables and divisions by the (constant) range
+// compile to multiplications. Inputs are clamped to [lower, upper]; outputs
+// differ from the float path by at most one unit. Ranges up to 2^16 - 1 are
+// supported.
+template <typename Scalar>
+struct color_lut {
+	static constexpr int lower = color_limits_t<Scalar>::lower;
+	static constexpr int upper = color_limits_t<Scalar>::upper;
+	static constexpr uint64_t range = upper - lower;
+	static constexpr uint64_t fraction_one = 1 << 16;
+	static constexpr uint64_t range_fraction = range * fraction_one;
+
+	std::vector<uint8_t>  sector;    // hue sector per hue value
+	std::vector<uint32_t> fraction;  // position within sector per hue value, scaled by fraction_one
+	std::vector<uint64_t> recip;     // ceil(2^47 / x)
+	std::vector<uint64_t> recip6;    // ceil(2^47 / 6x)
+
+	color_lut() : sector(range + 1), fraction(range + 1), recip(range + 1, 0), recip6(range + 1, 0) {
+		for (uint64_t i = 0; i <= range; ++i) {
+			float h = static_cast<float>(i) / static_cast<float>(range) * hue_scale<Scalar>();
+			float a = h / sector_width;
+			float c = std::floor(a);
+			sector[i] = (c >= 1.f && c <= 5.f) ? static_cast<uint8_t>(c) : 0;
+			fraction[i] = static_cast<uint32_t>(std::lround((a - c) * static_cast<float>(fraction_one)));
+			if (i) {
+				recip[i] = ((uint64_t(1) << 47) + i - 1) / i;
+				recip6[i] = ((uint64_t(1) << 47) + 6 * i - 1) / (6 * i);
+			}
+		}
+	}
+
+	static const color_lut& instance() {
+		static const color_lut lut;
+		return lut;
+	}
+
+	static int clamped(Scalar x) {
+		return std::min(std::max(static_cast<int>(x), lower), upper) - lower;
+	}
+
+	void hsv_to_rgb(Scalar h, Scalar s, Scalar v, Scalar* rgb) const {
+		uint64_t ih = clamped(h), is = clamped(s), iv = clamped(v);
+		uint64_t f = fraction[ih];
+		uint64_t channels[4] = {
+			iv,
+			iv * (range - is) / range,
+			iv * (range_fraction - is * f) / range_fraction,
+			iv * (range_fraction - is * (fraction_one - f)) / range_fraction
+		};
+		const int* order = sector_channels[sector[ih]];
+		rgb[0] = static_cast<Scalar>(channels[order[0]] + lower);
+		rgb[1] = static_cast<Scalar>(channels[order[1]] + lower);
+		rgb[2] = static_cast<Scalar>(channels[order[2]] + lower);
+	}
+
+	void rgb_to_hsv(Scalar r, Scalar g, Scalar b, Scalar* hsv) const {
+		int64_t ir = clamped(r), ig = clamped(g), ib = clamped(b);
+		int64_t max = std::max(std::max(ir, ig), ib);
+		int64_t min = std::min(std::min(ir, ig), ib);
+		int64_t d = max - min;
+		uint64_t h = 0, s = 0;
+		if (d) {
+			// position on the circle in units of d / 6
+			int64_t pos = max == ir ? ig - ib : (max == ig ? 2 * d + ib - ir : 4 * d + ir - ig);
+			if (pos < 0) pos += 6 * d;
+			h = (static_cast<uint64_t>(pos) * range * recip6[d]) >> 47;
+			s = std::min((static_cast<uint64_t>(d) * range * recip[max]) >> 47, range);
+		}
+		hsv[0] = static_cast<Scalar>(h + lower);
+		hsv[1] = static_cast<Scalar>(s + lower);
+		hsv[2] = static_cast<Scalar>(max + lower);
+	}
+};
+
+template <typename Scalar> constexpr int color_lut<Scalar>::lower;
+template <typename Scalar> constexpr int color_lut<Scalar>::upper;
+template <typename Scalar> constexpr uint64_t color_lut<Scalar>::range;
+template <typename Scalar> constexpr uint64_t color_lut<Scalar>::fraction_one;
+template <typename Scalar> constexpr uint64_t color_lut<Scalar>::range_fraction;
+
+template <class TargetType, class SourceType, bool SameSpace = color_traits<TargetType>::is_hsv == color_traits<SourceType>::is_hsv>
+struct lut_convert : batch_convert<TargetType, SourceType, true> {
+};
+
+template <class TargetType, class SourceType>
+struct lut_convert<TargetType, SourceType, false> : batch_convert<TargetType, SourceType, false> {
+	typedef batch_convert<TargetType, SourceType, false> base_t;
+	typedef typename base_t::scalar_type scalar_type;
+
+	template <class Input, class Output>
+	static void run(const Input& input, const Output& output) {
+		const color_lut<scalar_type>& lut = color_lut<scalar_type>::instance();
+		for (std::size_t i = 0; i < input.size(); ++i) {
+			const SourceType& in = load(input, i);
+			TargetType out;
+			if (color_traits<SourceType>::is_hsv) {
+				lut.hsv_to_rgb(in[0], in[1], in[2], out.data());
+			} else {
+				lut.rgb_to_hsv(in[0], in[1], in[2], out.data());
+			}
+			base_t::set_alpha(out, base_t::alpha(in, typename base_t::source_alpha()), typename base_t::target_alpha());
+			store(output, i, out);
+		}
+	}
+};
+
+// Fixed point conversions for integral scalars. For HSV -> RGB channels are
+// rescaled to unsigned 16 bit (hue as 1/65536 turns) and processed on 16 bit
+// lanes using only multiply-high, subtract and select, so the SSE2 kernel
+// and the scalar one agree exactly. RGB -> HSV stays in the scalar's own
+// integer domain (requantizing would blow up hue errors for nearly gray
+// colors) and uses the reciprocal tables of color_lut.
+namespace fixed {
+
+inline uint16_t mulhi(uint32_t a, uint32_t b) {
+	return static_cast<uint16_t>((a * b) >> 16);
+}
+
+inline void hsv_to_rgb(uint16_t h, uint16_t s, uint16_t v, uint16_t& r, uint16_t& g, uint16_t& b) {
+	uint32_t h6 = uint32_t(h) * 6;
+	uint16_t f = static_cast<uint16_t>(h6);
+	uint16_t sf = mulhi(s, f);
+	uint16_t channels[4] = {
+		v,
+		static_cast<uint16_t>(v - mulhi(v, s)),
+		static_cast<uint16_t>(v - mulhi(v, sf)),
+		static_cast<uint16_t>(v - mulhi(v, s - sf))
+	};
+	const int* order = sector_channels[h6 >> 16];
+	r = channels[order[0]];
+	g = channels[order[1]];
+	b = channels[order[2]];
+}
+
+void hsv_to_rgb_scalar(uint16_t* x, uint16_t* y, uint16_t* z, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		hsv_to_rgb(x[i], y[i], z[i], x[i], y[i], z[i]);
+	}
+}
+
+#ifdef DAMOGRAN_COLORS_X86
+void hsv_to_rgb_sse2(uint16_t* x, uint16_t* y, uint16_t* z, std::size_t n) {
+	const __m128i six = _mm_set1_epi16(6);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i));
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z + i));
+		__m128i c = _mm_mulhi_epu16(h, six);
+		__m128i f = _mm_mullo_epi16(h, six);
+		__m128i sf = _mm_mulhi_epu16(s, f);
+		__m128i p = _mm_sub_epi16(v, _mm_mulhi_epu16(v, s));
+		__m128i q = _mm_sub_epi16(v, _mm_mulhi_epu16(v, sf));
+		__m128i t = _mm_sub_epi16(v, _mm_mulhi_epu16(v, _mm_sub_epi16(s, sf)));
+
+		__m128i r = v, g = t, b = p;
+		auto select = [] (__m128i mask, __m128i a, __m128i b) {
+			return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+		};
+		__m128i m = _mm_cmpeq_epi16(c, _mm_set1_epi16(1));
+		r = select(m, q, r); g = select(m, v, g);
+		m = _mm_cmpeq_epi16(c, _mm_set1_epi16(2));
+		r = select(m, p, r); g = select(m, v, g); b = select(m, t, b);
+		m = _mm_cmpeq_epi16(c, _mm_set1_epi16(3));
+		r = select(m, p, r); g = select(m, q, g); b = select(m, v, b);
+		m = _mm_cmpeq_epi16(c, _mm_set1_epi16(4));
+		r = select(m, t, r); g = select(m, p, g); b = select(m, v, b);
+		m = _mm_cmpeq_epi16(c, _mm_set1_epi16(5));
+		g = select(m, p, g); b = select(m, q, b);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(x + i), r);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), g);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), b);
+	}
+	hsv_to_rgb_scalar(x + i, y + i, z + i, n - i);
+}
+#endif // DAMOGRAN_COLORS_X86
+
+typedef void (*lane_kernel_t)(uint16_t* x, uint16_t* y, uint16_t* z, std::size_t n);
+
+lane_kernel_t hsv_to_rgb_kernel() {
+#ifdef DAMOGRAN_COLORS_X86
+	return &hsv_to_rgb_sse2;
+#else
+	return &hsv_to_rgb_scalar;
+#endif
+}
+
+// rescaling between [lower, upper] and 16 bit, rounding to nearest
+template <typename Scalar>
+struct scale {
+	static constexpr int64_t lower = color_limits_t<Scalar>::lower;
+	static constexpr int64_t upper = color_limits_t<Scalar>::upper;
+	static constexpr uint64_t range = upper - lower;
+
+	static uint64_t clamped(Scalar x) {
+		return static_cast<uint64_t>(std::min<int64_t>(std::max<int64_t>(x, lower), upper) - lower);
+	}
+
+	static uint16_t channel_in(Scalar x) {
+		return static_cast<uint16_t>((clamped(x) * 65535 + range / 2) / range);
+	}
+
+	static Scalar channel_out(uint16_t x) {
+		return static_cast<Scalar>((uint64_t(x) * range + 32767) / 65535 + lower);
+	}
+
+	// upper is the full circle and wraps to lower
+	static uint16_t hue_in(Scalar h) {
+		return static_cast<uint16_t>(((clamped(h) << 16) + range / 2) / range);
+	}
+};
+
+template <typename Scalar> constexpr int64_t scale<Scalar>::lower;
+template <typename Scalar> constexpr int64_t scale<Scalar>::upper;
+template <typename Scalar> constexpr uint64_t scale<Scalar>::range;
+
+} // fixed
+
+template <class TargetType, class SourceType, bool SameSpace = color_traits<TargetType>::is_hsv == color_traits<SourceType>::is_hsv>
+struct fixed_convert : batch_convert<TargetType, SourceType, true> {
+};
+
+template <class TargetType, class SourceType, bool FromHSV = color_traits<SourceType>::is_hsv>
+struct fixed_convert_hue : lut_convert<TargetType, SourceType, false> {
+};
+
+template <class TargetType, class SourceType>
+struct fixed_convert_hue<TargetType, SourceType, true> : batch_convert<TargetType, SourceType, false> {
+	typedef batch_convert<TargetType, SourceType, false> base_t;
+	typedef typename base_t::scalar_type scalar_type;
+	typedef fixed::scale<scalar_type> scale_t;
+
+	template <class Input, class Output>
+	static void run(const Input& input, const Output& output) {
+		fixed::lane_kernel_t kernel = fixed::hsv_to_rgb_kernel();
+
+		alignas(16) uint16_t x[lane_block];
+		alignas(16) uint16_t y[lane_block];
+		alignas(16) uint16_t z[lane_block];
+		scalar_type a[lane_block];
+		for (std::size_t offset = 0; offset < input.size(); offset += lane_block) {
+			std::size_t n = std::min(lane_block, input.size() - offset);
+			for (std::size_t i = 0; i < n; ++i) {
+				const SourceType& in = load(input, offset + i);
+				x[i] = scale_t::hue_in(in[0]);
+				y[i] = scale_t::channel_in(in[1]);
+				z[i] = scale_t::channel_in(in[2]);
+				a[i] = base_t::alpha(in, typename base_t::source_alpha());
+			}
+			kernel(x, y, z, n);
+			for (std::size_t i = 0; i < n; ++i) {
+				TargetType out;
+				out[0] = scale_t::channel_out(x[i]);
+				out[1] = scale_t::channel_out(y[i]);
+				out[2] = scale_t::channel_out(z[i]);
+				base_t::set_alpha(out, a[i], typename base_t::target_alpha());
+				store(output, offset + i, out);
+			}
+		}
+	}
+};
+
+template <class TargetType, class SourceType>
+struct fixed_convert<TargetType, SourceType, false> : fixed_convert_hue<TargetType, SourceType> {
+};
+
+} // detail
+
+template <typename Scalar>
+RGB<Scalar>::RGB() : col_vec3_t<Scalar>() {
 }
 
 template <typename Scalar>
-RGB<Scalar>::RGB(const RGB<Scalar>& rgb) : col_vec3_t<Scalar>(rgb) {
+RGB<Scalar>::RGB(Scalar r, Scalar g, Scalar b) : col_vec3_t<Scalar>(r,g,b) {
 }
 
 template <typename Scalar>
@@ -87,32 +687,12 @@ RGB<Scalar>::RGB(const HSV<Scalar>& hsv) {
 	float range = static_cast<float>(color_limits_t<Scalar>::upper - color_limits_t<Scalar>::lower);
 
 	Eigen::Vector3f vec = hsv.head(3).template cast<float>();
-  	vec -= Eigen::Vector3f::Constant(lower);
-  	vec /= static_cast<float>(range);
-	float a = vec[0] / (static_cast<float>(M_PI) / 3.f);
-	float c = std::floor(a);
-	float f = a - c;
-	float p = vec[2] * (1-vec[1]);
-	float q = vec[2] * (1-vec[1]*f);
-	float t = vec[2] * (1-vec[1]*(1-f));
-
-	float r, g, b;
-
-	if (c == 1) {
-		r = q; g = vec[2]; b = p;
-	} else if (c == 2) {
-		r = p; g = vec[2]; b = t;
-	} else if (c == 3) {
-		r = p; g = q; b = vec[2];
-	} else if (c == 4) {
-		r = t; g = p; b = vec[2];
-	} else if (c == 5) {
-		r = vec[2]; g = p; b = q;
-	} else {
-		r = vec[2]; g = t; b = p;
-	}
-
-	Eigen::Vector3f rgb(r, g, b);
+	vec -= Eigen::Vector3f::Constant(lower);
+	vec /= static_cast<float>(range);
+	vec[0] *= detail::hue_scale<Scalar>();
+
+	Eigen::Vector3f rgb;
+	detail::hsv_to_rgb(vec[0], vec[1], vec[2], rgb[0], rgb[1], rgb[2]);
 	rgb = rgb * range + Eigen::Vector3f::Constant(lower);
 	(*this) = RGB<Scalar>(Scalar(rgb[0]), Scalar(rgb[1]), Scalar(rgb[2]));
 }
@@ -121,10 +701,6 @@ template <typename Scalar>
 RGB<Scalar>::RGB(const HSVA<Scalar>& hsva) : RGB<Scalar>(HSV<Scalar>(hsva)) {
 }
 
-template <typename Scalar>
-RGB<Scalar>::~RGB() {
-}
-
 template <typename Scalar>
 RGBA<Scalar>::RGBA() : col_vec4_t<Scalar>() {
 }
@@ -139,10 +715,6 @@ RGBA<Scalar>::RGBA(const RGB<Scalar>& rgb) {
 	(*this)[3] = Scalar(1);
 }
 
-template <typename Scalar>
-RGBA<Scalar>::RGBA(const RGBA<Scalar>& rgba) : col_vec4_t<Scalar>(rgba) {
-}
-
 template <typename Scalar>
 RGBA<Scalar>::RGBA(const HSV<Scalar>& hsv) : RGBA<Scalar>(RGB<Scalar>(hsv)) {
 }
@@ -152,10 +724,6 @@ RGBA<Scalar>::RGBA(const HSVA<Scalar>& hsva) : RGBA<Scalar>(HSV<Scalar>(hsva)) {
 	(*this)[3] = hsva.a();
 }
 
-template <typename Scalar>
-RGBA<Scalar>::~RGBA() {
-}
-
 template <typename Scalar>
 HSV<Scalar>::HSV() : col_vec3_t<Scalar>() {
 }
@@ -170,27 +738,11 @@ HSV<Scalar>::HSV(const RGB<Scalar>& rgb) {
 	float lower = static_cast<float>(color_limits_t<Scalar>::lower);
 	float range = static_cast<float>(color_limits_t<Scalar>::upper - color_limits_t<Scalar>::lower);
 	vec = (vec - Eigen::Vector3f::Constant(lower)) / range;
-	Scalar min = std::min(std::min(vec[0], vec[1]), vec[2]);
-	Scalar max = std::max(std::max(vec[0], vec[1]), vec[2]);
 
-	float h;
-	if (min == max) {
-		h = 0.f;
-	} else if (max == vec[0]) {
-		h = static_cast<float>(M_PI) / 3.f * ((vec[1]-vec[2]) / (max-min));
-	} else if (max == vec[1]) {
-		h = static_cast<float>(M_PI) / 3.f * (2.f + (vec[2]-vec[0]) / (max-min));
-	} else {
-		h = static_cast<float>(M_PI) / 3.f * (4.f + (vec[0]-vec[1]) / (max-min));
-	}
-	if (h < 0.0) {
-		h += static_cast<float>(M_PI) * 2.f;
-	}
-
-	float s = max == 0.f ? 0.f : (max-min) / max;
-	float v = max;
-
-	vec = Eigen::Vector3f(h, s, v) * range + Eigen::Vector3f::Constant(lower);
+	Eigen::Vector3f hsv;
+	detail::rgb_to_hsv(vec[0], vec[1], vec[2], hsv[0], hsv[1], hsv[2]);
+	hsv[0] /= detail::hue_scale<Scalar>();
+	vec = hsv * range + Eigen::Vector3f::Constant(lower);
 	(*this) = HSV(Scalar(vec[0]), Scalar(vec[1]), Scalar(vec[2]));
 }
 
@@ -198,18 +750,10 @@ template <typename Scalar>
 HSV<Scalar>::HSV(const RGBA<Scalar>& rgba) : HSV<Scalar>(RGB<Scalar>(rgba)) {
 }
 
-template <typename Scalar>
-HSV<Scalar>::HSV(const HSV<Scalar>& hsv) : col_vec3_t<Scalar>(hsv) {
-}
-
 template <typename Scalar>
 HSV<Scalar>::HSV(const HSVA<Scalar>& hsva) : col_vec3_t<Scalar>(hsva.head(3)) {
 }
 
-template <typename Scalar>
-HSV<Scalar>::~HSV() {
-}
-
 template <typename Scalar>
 HSVA<Scalar>::HSVA() : col_vec4_t<Scalar>() {
 }
@@ -234,37 +778,49 @@ HSVA<Scalar>::HSVA(const HSV<Scalar>& hsv) {
 	(*this)[3] = Scalar(1);
 }
 
-template <typename Scalar>
-HSVA<Scalar>::HSVA(const HSVA<Scalar>& hsva) : col_vec4_t<Scalar>(hsva) {
+template <class ColorType>
+typename generate<ColorType>::color_type generate<ColorType>::random_hue(scalar_type value, scalar_type saturation, scalar_type alpha) {
+	auto lower = color_limits_t<scalar_type>::lower;
+	auto upper = detail::hue_upper<scalar_type>();
+	return color_type(HSVA<scalar_type>(rng::uniform_ab<scalar_type>(lower, upper), saturation, value, alpha));
 }
 
-template <typename Scalar>
-HSVA<Scalar>::~HSVA() {
+template <class ColorType>
+std::vector<typename generate<ColorType>::color_type> generate<ColorType>::random_hues(uint32_t count, scalar_type value, scalar_type saturation, scalar_type alpha) {
+	std::vector<color_type> result(count);
+	uint64_t seed = (uint64_t(rng::engine()()) << 32) | rng::engine()();
+	random_hues(span<color_type>(result), seed, value, saturation, alpha);
+	return result;
 }
 
 template <class ColorType>
-typename generate<ColorType>::color_type generate<ColorType>::random_hue(scalar_type value, scalar_type saturation, scalar_type alpha) {
+void generate<ColorType>::random_hues(span<color_type> output, uint64_t seed, scalar_type value, scalar_type saturation, scalar_type alpha, unsigned int threads) {
 	auto lower = color_limits_t<scalar_type>::lower;
-	auto upper = color_limits_t<scalar_type>::upper;
-	return color_type(HSVA<scalar_type>(rng::uniform_ab<scalar_type>(lower, upper), value, saturation, alpha));
+	auto upper = rng::traits_t<scalar_type>::upper_bound(detail::hue_upper<scalar_type>(), std::is_floating_point<scalar_type>());
+	parallel_chunks(output.size(), detail::palette_chunk, [&] (std::size_t chunk, std::size_t begin, std::size_t end) {
+		// every chunk draws from its own stream, so output only depends on seed
+		std::seed_seq seq{uint32_t(seed), uint32_t(seed >> 32), uint32_t(chunk), uint32_t(uint64_t(chunk) >> 32)};
+		rng::internal_generator_t gen(seq);
+		typename rng::traits_t<scalar_type>::dist_ab_t hue(lower, upper);
+		for (std::size_t i = begin; i < end; ++i) {
+			output[i] = color_type(HSVA<scalar_type>(hue(gen), saturation, value, alpha));
+		}
+	}, threads);
 }
 
 template <class ColorType>
-std::vector<typename generate<ColorType>::color_type> generate<ColorType>::random_hues(uint32_t count, scalar_type value, scalar_type saturation, scalar_type alpha) {
-	auto lower = color_limits_t<scalar_type>::lower;
-	auto upper = color_limits_t<scalar_type>::upper;
-	auto gen = rng::uniform_ab_gen<scalar_type>(lower, upper);
+std::vector<typename generate<ColorType>::color_type> generate<ColorType>::uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha) {
 	std::vector<color_type> result(count);
-	for (uint32_t i = 0; i < count; ++i) {
-		result[i] = color_type(HSVA<scalar_type>(gen(), value, saturation, alpha));
-	}
+	uniform(span<color_type>(result), hue_range, value_range, sat_range, alpha);
+	return result;
 }
 
 template <class ColorType>
-std::vector<typename generate<ColorType>::color_type> generate<ColorType>::uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha) {
+void generate<ColorType>::uniform(span<color_type> output, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha, unsigned int threads) {
 	auto lower = color_limits_t<scalar_type>::lower;
 	auto upper = color_limits_t<scalar_type>::upper;
 	float range = static_cast<float>(upper) - static_cast<float>(lower);
+	std::size_t count = output.size();
 
 
 	float r_hue = 2.f * M_PI * static_cast<float>(hue_range.second - hue_range.first) / range;
@@ -292,38 +848,243 @@ std::vector<typename generate<ColorType>::color_type> generate<ColorType>::unifo
 	float s_h = r_hue / (c_h > 0.f ? c_h : 1.f);
 	float s_s = r_sat / (c_s > 1.f ? c_s - 1.f : 1.f);
 	float s_l = r_light / (c_l > 1.f ? c_l - 1.f : 2.f);
-	std::vector<color_type> result;
-	for (unsigned int i=0; i<c_h; ++i) {
-		float h = l_hue + static_cast<float>(i) * s_h;
-		for (unsigned int j=0; j<c_s; ++j) {
+
+	// grid cell (i, j, k) lands at index (i * c_s + j) * c_l + k
+	parallel_chunks(count, detail::palette_chunk, [&] (std::size_t, std::size_t begin, std::size_t end) {
+		for (std::size_t idx = begin; idx < end; ++idx) {
+			std::size_t i = idx / (c_s * c_l);
+			std::size_t j = (idx / c_l) % c_s;
+			std::size_t k = idx % c_l;
+			float h = l_hue + static_cast<float>(i) * s_h;
 			float s = l_sat + static_cast<float>(j) * s_s;
-			for (unsigned int k=0; k<c_l; ++k) {
-				float l = l_light + static_cast<float>(k) * s_l;
-				result.push_back(color_type(HSVA<scalar_type>(h, s, l, alpha)));
-			}
+			float l = l_light + static_cast<float>(k) * s_l;
+			output[idx] = color_type(HSVA<scalar_type>(
+				scalar_type(h / detail::hue_scale<scalar_type>() * range + lower),
+				scalar_type(s * range + lower),
+				scalar_type(l * range + lower),
+				alpha));
 		}
-	}
-	result.resize(count);
-	return result;
+	}, threads);
 }
 
 template <class ColorType>
 std::vector<typename generate<ColorType>::color_type> generate<ColorType>::shuffled_uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha) {
 	auto colors = uniform(count, hue_range, value_range, sat_range, alpha);
-	uint32_t seed = std::chrono::system_clock::now().time_since_epoch().count();
-	std::shuffle(colors.begin(), colors.end(), std::default_random_engine(seed));
+	std::shuffle(colors.begin(), colors.end(), rng::engine());
 	return colors;
 }
 
+template <class ColorType>
+palette_index<ColorType>::palette_index(const std::vector<color_type>& palette) : palette_(palette) {
+	if (palette_.empty()) {
+		throw std::runtime_error("palette_index: Empty palette.");
+	}
+	points_.resize(palette_.size());
+	order_.resize(palette_.size());
+	for (uint32_t i = 0; i < palette_.size(); ++i) {
+		points_[i] = coords(palette_[i]);
+		order_[i] = i;
+	}
+	nodes_.reserve(2 * palette_.size() / detail::leaf_size + 1);
+	build(0, static_cast<uint32_t>(palette_.size()));
+}
+
+template <class ColorType>
+const std::vector<typename palette_index<ColorType>::color_type>& palette_index<ColorType>::palette() const {
+	return palette_;
+}
 
-#define TYPE_LIST \
-	X(float) \
-	X(double) \
-	X(short) \
-	X(int) \
-	X(unsigned int) \
-	X(char) \
-	X(unsigned char)
+template <class ColorType>
+uint32_t palette_index<ColorType>::nearest(const color_type& color) const {
+	Eigen::Vector3f point = coords(color);
+	uint32_t best = 0;
+	float best_distance = std::numeric_limits<float>::infinity();
+	search(0, point, best, best_distance);
+	return best;
+}
+
+template <class ColorType>
+void palette_index<ColorType>::nearest(span<const color_type> colors, span<uint32_t> indices, unsigned int threads) const {
+	if (colors.size() != indices.size()) {
+		throw std::runtime_error("palette_index::nearest: Input and output spans differ in size.");
+	}
+	parallel_chunks(colors.size(), detail::query_chunk, [&] (std::size_t, std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; ++i) {
+			indices[i] = nearest(colors[i]);
+		}
+	}, threads);
+}
+
+template <class ColorType>
+void palette_index<ColorType>::quantize(span<const color_type> colors, span<color_type> output, unsigned int threads) const {
+	if (colors.size() != output.size()) {
+		throw std::runtime_error("palette_index::quantize: Input and output spans differ in size.");
+	}
+	parallel_chunks(colors.size(), detail::query_chunk, [&] (std::size_t, std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; ++i) {
+			output[i] = palette_[nearest(colors[i])];
+		}
+	}, threads);
+}
+
+template <class ColorType>
+Eigen::Vector3f palette_index<ColorType>::coords(const color_type& color) const {
+	const float lower = static_cast<float>(color_limits_t<scalar_type>::lower);
+	const float range = static_cast<float>(color_limits_t<scalar_type>::upper - color_limits_t<scalar_type>::lower);
+	Eigen::Vector3f point = (color.head(3).template cast<float>() - Eigen::Vector3f::Constant(lower)) / range;
+	if (detail::color_traits<color_type>::is_hsv) {
+		float turn = point[0] * detail::hue_scale<scalar_type>() / detail::full_circle;
+		point[0] = turn - std::floor(turn);
+	}
+	return point;
+}
+
+template <class ColorType>
+float palette_index<ColorType>::box_distance(const Eigen::Vector3f& point, const node& n) const {
+	float sum = 0.f;
+	for (int i = 0; i < 3; ++i) {
+		float d = 0.f;
+		if (point[i] < n.lower[i]) {
+			d = n.lower[i] - point[i];
+			if (i == 0 && detail::color_traits<color_type>::is_hsv) d = std::min(d, 1.f - n.upper[i] + point[i]);
+		} else if (point[i] > n.upper[i]) {
+			d = point[i] - n.upper[i];
+			if (i == 0 && detail::color_traits<color_type>::is_hsv) d = std::min(d, 1.f - point[i] + n.lower[i]);
+		}
+		sum += d * d;
+	}
+	return sum;
+}
+
+template <class ColorType>
+float palette_index<ColorType>::distance(const Eigen::Vector3f& a, const Eigen::Vector3f& b) const {
+	Eigen::Vector3f d = (a - b).cwiseAbs();
+	if (detail::color_traits<color_type>::is_hsv) {
+		d[0] = std::min(d[0], 1.f - d[0]);
+	}
+	return d.squaredNorm();
+}
+
+template <class ColorType>
+int32_t palette_index<ColorType>::build(uint32_t begin, uint32_t end) {
+	node n;
+	n.begin = begin;
+	n.end = end;
+	n.children[0] = n.children[1] = -1;
+	n.lower = n.upper = points_[order_[begin]];
+	for (uint32_t i = begin + 1; i < end; ++i) {
+		n.lower = n.lower.cwiseMin(points_[order_[i]]);
+		n.upper = n.upper.cwiseMax(points_[order_[i]]);
+	}
+	// parents precede their children
+	int32_t index = static_cast<int32_t>(nodes_.size());
+	nodes_.push_back(n);
+	if (end - begin > detail::leaf_size) {
+		int axis;
+		(n.upper - n.lower).maxCoeff(&axis);
+		uint32_t middle = begin + (end - begin) / 2;
+		std::nth_element(order_.begin() + begin, order_.begin() + middle, order_.begin() + end, [&] (uint32_t a, uint32_t b) {
+			return points_[a][axis] < points_[b][axis];
+		});
+		int32_t left = build(begin, middle);
+		int32_t right = build(middle, end);
+		nodes_[index].children[0] = left;
+		nodes_[index].children[1] = right;
+	}
+	return index;
+}
+
+template <class ColorType>
+void palette_index<ColorType>::search(int32_t node_index, const Eigen::Vector3f& point, uint32_t& best, float& best_distance) const {
+	const node& n = nodes_[node_index];
+	if (n.children[0] < 0) {
+		for (uint32_t i = n.begin; i < n.end; ++i) {
+			float d = distance(point, points_[order_[i]]);
+			// ties resolve to the lower palette index independent of tree layout
+			if (d < best_distance || (d == best_distance && order_[i] < best)) {
+				best_distance = d;
+				best = order_[i];
+			}
+		}
+		return;
+	}
+	float d0 = box_distance(point, nodes_[n.children[0]]);
+	float d1 = box_distance(point, nodes_[n.children[1]]);
+	int first = d1 < d0 ? 1 : 0;
+	float d_first = first ? d1 : d0;
+	float d_second = first ? d0 : d1;
+	if (d_first <= best_distance) search(n.children[first], point, best, best_distance);
+	if (d_second <= best_distance) search(n.children[1 - first], point, best, best_distance);
+}
+
+template <class TargetType, class SourceType>
+void convert(span<const SourceType> input, span<TargetType> output) {
+	if (input.size() != output.size()) {
+		throw std::runtime_error("convert: Input and output spans differ in size.");
+	}
+	detail::batch_convert<TargetType, SourceType>::run(input, output);
+}
+
+template <class TargetType, class SourceType>
+void convert_lut(span<const SourceType> input, span<TargetType> output) {
+	if (input.size() != output.size()) {
+		throw std::runtime_error("convert_lut: Input and output spans differ in size.");
+	}
+	detail::lut_convert<TargetType, SourceType>::run(input, output);
+}
+
+template <class TargetType, class SourceType>
+void convert_lut(packed_color_view<const SourceType> input, packed_color_view<TargetType> output) {
+	if (input.size() != output.size()) {
+		throw std::runtime_error("convert_lut: Input and output views differ in size.");
+	}
+	detail::lut_convert<TargetType, SourceType>::run(input, output);
+}
+
+template <class TargetType, class SourceType>
+void convert_fixed(span<const SourceType> input, span<TargetType> output) {
+	if (input.size() != output.size()) {
+		throw std::runtime_error("convert_fixed: Input and output spans differ in size.");
+	}
+	detail::fixed_convert<TargetType, SourceType>::run(input, output);
+}
+
+template <class TargetType, class SourceType>
+void convert_fixed(packed_color_view<const SourceType> input, packed_color_view<TargetType> output) {
+	if (input.size() != output.size()) {
+		throw std::runtime_error("convert_fixed: Input and output views differ in size.");
+	}
+	detail::fixed_convert<TargetType, SourceType>::run(input, output);
+}
+
+template <class TargetType, class SourceType>
+void convert(packed_color_view<const SourceType> input, packed_color_view<TargetType> output) {
+	if (input.size() != output.size()) {
+		throw std::runtime_error("convert: Input and output views differ in size.");
+	}
+	detail::batch_convert<TargetType, SourceType>::run(input, output);
+}
+
+
+#define TYPE_LIST COLOR_SCALAR_TYPES
+
+// instantiate palette indices
+#define X(type) \
+	template class palette_index<RGB<type>>; \
+	template class palette_index<RGBA<type>>; \
+	template class palette_index<HSV<type>>; \
+	template class palette_index<HSVA<type>>;
+TYPE_LIST
+#undef X
+
+// color types must not carry anything but their channels
+#define X(type) \
+	static_assert(sizeof(RGB<type>) == 3 * sizeof(type), "RGB<" #type "> is not packed"); \
+	static_assert(sizeof(HSV<type>) == 3 * sizeof(type), "HSV<" #type "> is not packed"); \
+	static_assert(sizeof(RGBA<type>) == 4 * sizeof(type), "RGBA<" #type "> is not packed"); \
+	static_assert(sizeof(HSVA<type>) == 4 * sizeof(type), "HSVA<" #type "> is not packed");
+TYPE_LIST
+#undef X
 
 // instantiate color types
 #define X(type) \
@@ -338,22 +1099,89 @@ TYPE_LIST
 #define X(type) \
 	template RGB<type> generate<RGB<type>>::random_hue(type value, type saturation, type alpha); \
 	template std::vector<RGB<type>> generate<RGB<type>>::random_hues(uint32_t count, type value, type saturation, type alpha); \
+	template void generate<RGB<type>>::random_hues(span<RGB<type>> output, uint64_t seed, type value, type saturation, type alpha, unsigned int threads); \
 	template std::vector<RGB<type>> generate<RGB<type>>::uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
+	template void generate<RGB<type>>::uniform(span<RGB<type>> output, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha, unsigned int threads); \
 	template std::vector<RGB<type>> generate<RGB<type>>::shuffled_uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
 	template RGBA<type> generate<RGBA<type>>::random_hue(type value, type saturation, type alpha); \
 	template std::vector<RGBA<type>> generate<RGBA<type>>::random_hues(uint32_t count, type value, type saturation, type alpha); \
+	template void generate<RGBA<type>>::random_hues(span<RGBA<type>> output, uint64_t seed, type value, type saturation, type alpha, unsigned int threads); \
 	template std::vector<RGBA<type>> generate<RGBA<type>>::uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
+	template void generate<RGBA<type>>::uniform(span<RGBA<type>> output, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha, unsigned int threads); \
 	template std::vector<RGBA<type>> generate<RGBA<type>>::shuffled_uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
 	template HSV<type> generate<HSV<type>>::random_hue(type value, type saturation, type alpha); \
 	template std::vector<HSV<type>> generate<HSV<type>>::random_hues(uint32_t count, type value, type saturation, type alpha); \
+	template void generate<HSV<type>>::random_hues(span<HSV<type>> output, uint64_t seed, type value, type saturation, type alpha, unsigned int threads); \
 	template std::vector<HSV<type>> generate<HSV<type>>::uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
+	template void generate<HSV<type>>::uniform(span<HSV<type>> output, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha, unsigned int threads); \
 	template std::vector<HSV<type>> generate<HSV<type>>::shuffled_uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
 	template HSVA<type> generate<HSVA<type>>::random_hue(type value, type saturation, type alpha); \
 	template std::vector<HSVA<type>> generate<HSVA<type>>::random_hues(uint32_t count, type value, type saturation, type alpha); \
+	template void generate<HSVA<type>>::random_hues(span<HSVA<type>> output, uint64_t seed, type value, type saturation, type alpha, unsigned int threads); \
 	template std::vector<HSVA<type>> generate<HSVA<type>>::uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha); \
+	template void generate<HSVA<type>>::uniform(span<HSVA<type>> output, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha, unsigned int threads); \
 	template std::vector<HSVA<type>> generate<HSVA<type>>::shuffled_uniform(uint32_t count, const range_type& hue_range, const range_type& value_range, const range_type& sat_range, scalar_type alpha);
 TYPE_LIST
 #undef X
 
+#define CONVERT_PAIRS(type) \
+	CONVERT(RGB<type>, RGB<type>) \
+	CONVERT(RGB<type>, RGBA<type>) \
+	CONVERT(RGB<type>, HSV<type>) \
+	CONVERT(RGB<type>, HSVA<type>) \
+	CONVERT(RGBA<type>, RGB<type>) \
+	CONVERT(RGBA<type>, RGBA<type>) \
+	CONVERT(RGBA<type>, HSV<type>) \
+	CONVERT(RGBA<type>, HSVA<type>) \
+	CONVERT(HSV<type>, RGB<type>) \
+	CONVERT(HSV<type>, RGBA<type>) \
+	CONVERT(HSV<type>, HSV<type>) \
+	CONVERT(HSV<type>, HSVA<type>) \
+	CONVERT(HSVA<type>, RGB<type>) \
+	CONVERT(HSVA<type>, RGBA<type>) \
+	CONVERT(HSVA<type>, HSV<type>) \
+	CONVERT(HSVA<type>, HSVA<type>)
+
+// instantiate batch conversions
+#define CONVERT(target, source) \
+	template void convert<target, source>(span<const source> input, span<target> output); \
+	template void convert<target, source>(packed_color_view<const source> input, packed_color_view<target> output);
+#define X(type) CONVERT_PAIRS(type)
+TYPE_LIST
+#undef X
+#undef CONVERT
+
+// instantiate table driven conversions for 8 and 16 bit types
+#define LUT_TYPE_LIST \
+	X(short) \
+	X(char) \
+	X(unsigned char)
+
+#define CONVERT(target, source) \
+	template void convert_lut<target, source>(span<const source> input, span<target> output); \
+	template void convert_lut<target, source>(packed_color_view<const source> input, packed_color_view<target> output);
+#define X(type) CONVERT_PAIRS(type)
+LUT_TYPE_LIST
+#undef X
+#undef CONVERT
+
+// instantiate fixed point conversions for integral types
+#define FIXED_TYPE_LIST \
+	X(short) \
+	X(int) \
+	X(unsigned int) \
+	X(char) \
+	X(unsigned char)
+
+#define CONVERT(target, source) \
+	template void convert_fixed<target, source>(span<const source> input, span<target> output); \
+	template void convert_fixed<target, source>(packed_color_view<const source> input, packed_color_view<target> output);
+#define X(type) CONVERT_PAIRS(type)
+FIXED_TYPE_LIST
+#undef X
+#undef CONVERT
+
+#undef CONVERT_PAIRS
+
 
 } // damogran
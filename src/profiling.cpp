@@ -1,107 +1,1225 @@
 #include <profiling.hpp>
 
+#include <unordered_map>
+#include <thread>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(PROFILING_ALLOCATIONS) && defined(__GLIBC__)
+#include <malloc.h>
+#include <new>
+#define DAMOGRAN_PROFILING_ALLOCATIONS
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define DAMOGRAN_PROFILING_TSC
+#endif
+
+#include <macros.hpp>
+
 
 namespace damogran {
 
 
-profiling::profiling() {
+namespace {
+
+// names of all profiles, shared by all instances
+struct name_registry {
+	std::mutex                                mutex;
+	std::unordered_map<std::string, uint32_t> ids;
+	std::vector<std::string>                  names;
+};
+
+name_registry& names() {
+	// never destroyed, static profiling instances may need names at exit
+	static name_registry* registry = new name_registry();
+	return *registry;
+}
+
+std::atomic<uint64_t> next_serial(1);
+
+// live instances by serial, for threads retiring their buffers at exit
+struct instance_registry {
+	std::mutex                              mutex;
+	std::unordered_map<uint64_t, profiling*> instances;
+};
+
+instance_registry& instances() {
+	// never destroyed, threads may exit after static destruction
+	static instance_registry* registry = new instance_registry();
+	return *registry;
+}
+
+// set once the calling thread's buffers have been retired
+thread_local bool thread_exiting = false;
+
+uint64_t current_thread_id() {
+#ifdef __linux__
+	return static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+	return std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+}
+
+uint64_t process_id() {
+#ifdef __linux__
+	return static_cast<uint64_t>(getpid());
+#else
+	return 0;
+#endif
+}
+
+#ifdef __linux__
+int open_counter(uint32_t type, uint64_t config, int group) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	// context switches happen in the kernel, everything else is counted in
+	// user space only
+	attr.exclude_kernel = type != PERF_TYPE_SOFTWARE;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+std::string json_escape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(c)));
+			escaped += code;
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+} // anonymous
+
+
+profiling::trace_ring::trace_ring(std::size_t capacity) : head(0), tail(0), dropped(0), reported_dropped(0) {
+	std::size_t size = 1;
+	while (size < capacity) size *= 2;
+	events.resize(size);
+	mask = size - 1;
+}
+
+
+profiling::thread_buffer::thread_buffer(std::size_t index) : index(index), thread_id(current_thread_id()), size(0), ring(nullptr), counters_wanted(false), counters_applied(false), counter_mask(0), live(0), suppressed(0) {
+	for (int& fd : counter_fds) fd = -1;
+	for (auto& block : blocks) block.store(nullptr, std::memory_order_relaxed);
+	stack.reserve(64);
+	append(none, none);
+	stack.push_back(frame{0, time_point_t(), 1, false, 0, 0, nullptr});
+}
+
+profiling::thread_buffer::~thread_buffer() {
+	counters_wanted = false;
+	update_counters();
+	// nodes of reused buffers keep their buckets beyond size
+	for (std::size_t b = 0; b < max_blocks; ++b) {
+		node* block = blocks[b].load(std::memory_order_relaxed);
+		if (!block) break;
+		for (std::size_t i = 0; i < block_size << b; ++i) delete [] block[i].buckets;
+		delete [] block;
+	}
+}
+
+uint32_t profiling::thread_buffer::append(uint32_t parent, id_t id) {
+	uint32_t index = size.load(std::memory_order_relaxed);
+	std::size_t b = block_of(index);
+	if (b >= max_blocks) {
+		throw std::runtime_error("profiling::thread_buffer::append: Too many call tree nodes.");
+	}
+	unaccounted pause;
+	if (!blocks[b].load(std::memory_order_relaxed)) {
+		// value-initialization zeroes the atomics
+		blocks[b].store(new node[block_size << b](), std::memory_order_release);
+	}
+	node& added = at(index);
+	added.id = id;
+	added.parent = parent;
+	added.first_child = none;
+	added.next_sibling = none;
+	if (added.buckets) {
+		// left by the previous owner of a reused buffer
+		for (std::size_t i = 0; i < histogram::bucket_count; ++i) added.buckets[i].store(0, std::memory_order_relaxed);
+		added.inclusive.store(0, std::memory_order_relaxed);
+		added.calls.store(0, std::memory_order_relaxed);
+		added.open.store(0, std::memory_order_relaxed);
+		added.max_ns.store(0, std::memory_order_relaxed);
+		for (auto& counter : added.counters) counter.store(0, std::memory_order_relaxed);
+		added.allocations.store(0, std::memory_order_relaxed);
+		added.allocated_bytes.store(0, std::memory_order_relaxed);
+		added.peak_bytes.store(0, std::memory_order_relaxed);
+		added.reported_inclusive = 0;
+		added.reported_calls = 0;
+		added.reported_buckets.clear();
+		added.reported_counters.fill(0);
+		added.reported_allocations = 0;
+		added.reported_allocated_bytes = 0;
+	} else {
+		added.buckets = new std::atomic<uint64_t>[histogram::bucket_count]();
+	}
+	added.min_ns.store(~uint64_t(0), std::memory_order_relaxed);
+	if (parent != none) {
+		added.next_sibling = at(parent).first_child;
+		at(parent).first_child = index;
+	}
+	size.store(index + 1, std::memory_order_release);
+	return index;
+}
+
+void profiling::thread_buffer::absorb(thread_buffer& other) {
+	uint32_t other_size = other.size.load(std::memory_order_acquire);
+	std::vector<uint32_t> target(other_size, 0);
+	for (uint32_t i = 1; i < other_size; ++i) {
+		node& n = other.at(i);
+		uint32_t parent = target[n.parent];
+		uint32_t child = at(parent).first_child;
+		while (child != none && at(child).id != n.id) child = at(child).next_sibling;
+		if (child == none) child = append(parent, n.id);
+		target[i] = child;
+
+		node& into = at(child);
+		histogram latency = delta(n, true);
+		for (std::size_t b = 0; b < histogram::bucket_count; ++b) {
+			if (latency.buckets_[b]) into.buckets[b].store(into.buckets[b].load(std::memory_order_relaxed) + latency.buckets_[b], std::memory_order_relaxed);
+		}
+		if (latency.count()) {
+			if (latency.min() < into.min_ns.load(std::memory_order_relaxed)) into.min_ns.store(latency.min(), std::memory_order_relaxed);
+			if (latency.max() > into.max_ns.load(std::memory_order_relaxed)) into.max_ns.store(latency.max(), std::memory_order_relaxed);
+		}
+		rep_t inclusive = n.inclusive.load(std::memory_order_relaxed);
+		uint64_t calls = n.calls.load(std::memory_order_relaxed);
+		into.inclusive.store(into.inclusive.load(std::memory_order_relaxed) + inclusive - n.reported_inclusive, std::memory_order_relaxed);
+		into.calls.store(into.calls.load(std::memory_order_relaxed) + calls - n.reported_calls, std::memory_order_relaxed);
+		n.reported_inclusive = inclusive;
+		n.reported_calls = calls;
+		for (int c = 0; c < counter_count; ++c) {
+			uint64_t value = n.counters[c].load(std::memory_order_relaxed);
+			into.counters[c].store(into.counters[c].load(std::memory_order_relaxed) + value - n.reported_counters[c], std::memory_order_relaxed);
+			n.reported_counters[c] = value;
+		}
+		uint64_t allocations = n.allocations.load(std::memory_order_relaxed);
+		uint64_t allocated_bytes = n.allocated_bytes.load(std::memory_order_relaxed);
+		into.allocations.store(into.allocations.load(std::memory_order_relaxed) + allocations - n.reported_allocations, std::memory_order_relaxed);
+		into.allocated_bytes.store(into.allocated_bytes.load(std::memory_order_relaxed) + allocated_bytes - n.reported_allocated_bytes, std::memory_order_relaxed);
+		n.reported_allocations = allocations;
+		n.reported_allocated_bytes = allocated_bytes;
+		if (n.peak_bytes.load(std::memory_order_relaxed) > into.peak_bytes.load(std::memory_order_relaxed)) {
+			into.peak_bytes.store(n.peak_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+	counter_mask.store(counter_mask.load(std::memory_order_relaxed) | other.counter_mask.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void profiling::thread_buffer::reset() {
+	at(0).first_child = none;
+	size.store(1, std::memory_order_release);
+	stack.resize(1);
+	counter_starts.clear();
+	live = 0;
+	suppressed = 0;
+}
+
+void profiling::thread_buffer::update_counters() {
+	counters_applied = counters_wanted.load(std::memory_order_relaxed);
+#ifdef __linux__
+	for (int& fd : counter_fds) {
+		if (fd >= 0) close(fd);
+		fd = -1;
+	}
+	if (!counters_applied) return;
+
+	static const struct {
+		uint32_t type;
+		uint64_t config;
+	} events[counter_count] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES }
+	};
+	// the first counter that opens leads the group, missing ones are skipped
+	int leader = -1;
+	uint32_t mask = 0;
+	for (int c = 0; c < counter_count; ++c) {
+		counter_fds[c] = open_counter(events[c].type, events[c].config, leader);
+		if (counter_fds[c] < 0) continue;
+		if (leader < 0) leader = counter_fds[c];
+		mask |= 1u << c;
+	}
+	counter_mask = mask;
+#endif
+}
+
+bool profiling::thread_buffer::read_counters(counter_values& values) const {
+#ifdef __linux__
+	int leader = -1;
+	for (int fd : counter_fds) {
+		if (fd >= 0) {
+			leader = fd;
+			break;
+		}
+	}
+	if (leader < 0) return false;
+
+	// PERF_FORMAT_GROUP layout: count, time enabled, time running, values
+	uint64_t data[3 + counter_count];
+	if (read(leader, data, sizeof(data)) < static_cast<ssize_t>(3 * sizeof(uint64_t))) return false;
+	if (!data[2]) return false;
+	// scale up if the kernel multiplexed the group with other events
+	double scale = data[2] < data[1] ? static_cast<double>(data[1]) / data[2] : 1.0;
+	uint64_t i = 0;
+	for (int c = 0; c < counter_count; ++c) {
+		values[c] = 0;
+		if (counter_fds[c] < 0 || i >= data[0]) continue;
+		values[c] = scale == 1.0 ? data[3 + i] : static_cast<uint64_t>(data[3 + i] * scale);
+		++i;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool profiling::thread_buffer::begin_counters(std::size_t depth) {
+	if (counter_starts.size() <= depth) {
+		unaccounted pause;
+		counter_starts.resize(depth + 1);
+	}
+	return read_counters(counter_starts[depth]);
+}
+
+void profiling::thread_buffer::end_counters(node& n, std::size_t depth, uint64_t weight) {
+	counter_values values;
+	if (!read_counters(values)) return;
+	const counter_values& start = counter_starts[depth];
+	for (int c = 0; c < counter_count; ++c) {
+		if (values[c] <= start[c]) continue;
+		n.counters[c].store(n.counters[c].load(std::memory_order_relaxed) + weight * (values[c] - start[c]), std::memory_order_relaxed);
+	}
 }
 
+
+namespace {
+
+// DAMOGRAN_PROFILING=0 disables, any other value enables profiling at startup
+bool initially_enabled() {
+	const char* value = std::getenv("DAMOGRAN_PROFILING");
+	if (value && *value) return std::strcmp(value, "0") != 0 && std::strcmp(value, "off") != 0;
 #ifdef PROFILING
-void profiling::start(std::string name) {
-	if (profiles_.find(name) != profiles_.end()) {
-		profiles_[name].start = clock_t::now();
-		profiles_[name].finished = false;
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // anonymous
+
+std::atomic<bool> profiling::enabled_(initially_enabled());
+thread_local uint64_t profiling::cached_serial_ = 0;
+thread_local profiling::thread_buffer* profiling::cached_buffer_ = nullptr;
+std::atomic<bool> profiling::allocations_enabled_(false);
+thread_local profiling::thread_buffer* profiling::allocating_ = nullptr;
+
+profiling::profiling() : serial_(next_serial++), exited_(nullptr), exited_threads_(0), trace_capacity_(0), trace_first_(true), counters_enabled_(false) {
+	if (enabled()) clock::initialize();
+	instance_registry& registry = instances();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.instances[serial_] = this;
+}
+
+profiling::~profiling() {
+	{
+		// threads exiting from now on leave the buffers alone
+		instance_registry& registry = instances();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.instances.erase(serial_);
+	}
+	stop_trace();
+	// frees of the buffers must not be attributed to them
+	thread_buffer* own = local(false);
+	if (own && allocating_ == own) allocating_ = nullptr;
+}
+
+void profiling::enable(bool enabled) {
+	if (enabled) clock::initialize();
+	enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+
+namespace {
+
+#ifdef DAMOGRAN_PROFILING_TSC
+// time stamp counter and steady_clock nanoseconds read at the same time
+struct clock_sample {
+	uint64_t ticks;
+	int64_t  ns;
+};
+
+clock_sample sample_clocks() {
+	// the pair read closest together wins, the others were interrupted
+	clock_sample best{0, 0};
+	uint64_t spread = ~uint64_t(0);
+	for (int i = 0; i < 16; ++i) {
+		unsigned int aux;
+		uint64_t before = __rdtscp(&aux);
+		int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		uint64_t after = __rdtscp(&aux);
+		if (after - before < spread) {
+			spread = after - before;
+			best = clock_sample{before + spread / 2, ns};
+		}
+	}
+	return best;
+}
+
+double tsc_frequency(const clock_sample& from, const clock_sample& to) {
+	if (to.ticks <= from.ticks || to.ns <= from.ns) return 0.0;
+	return static_cast<double>(to.ticks - from.ticks) * 1e9 / static_cast<double>(to.ns - from.ns);
+}
+
+// rdtscp is available and the counter ticks at a constant rate in all
+// power states
+bool tsc_invariant() {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) return false;
+	__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+	if (!(edx & (1u << 27))) return false;
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return edx & (1u << 8);
+}
+#endif
+
+} // anonymous
+
+std::atomic<int> profiling::clock::source_(profiling::clock::steady);
+uint64_t profiling::clock::base_ticks_ = 0;
+profiling::clock::rep profiling::clock::base_ns_ = 0;
+uint64_t profiling::clock::mult_ = 0;
+double profiling::clock::frequency_ = 0.0;
+std::atomic<bool> profiling::clock::drifted_(false);
+
+void profiling::clock::initialize() {
+	static std::once_flag once;
+	std::call_once(once, [] {
+		const char* value = std::getenv("DAMOGRAN_PROFILING_CLOCK");
+		if (!value || std::strcmp(value, "steady")) use(tsc);
+	});
+}
+
+bool profiling::clock::calibrate() {
+	static std::once_flag once;
+	std::call_once(once, [] {
+#ifdef DAMOGRAN_PROFILING_TSC
+		if (!tsc_invariant()) return;
+		clock_sample first = sample_clocks();
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		clock_sample second = sample_clocks();
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		clock_sample third = sample_clocks();
+
+		// both intervals have to agree on a plausible frequency
+		double early = tsc_frequency(first, second);
+		double late = tsc_frequency(second, third);
+		if (early < 1e8 || early > 1e11 || std::abs(early - late) > 1e-3 * early) return;
+
+		frequency_ = tsc_frequency(first, third);
+		mult_ = static_cast<uint64_t>(std::ldexp(1e9 / frequency_, 32) + 0.5);
+		base_ticks_ = third.ticks;
+		base_ns_ = third.ns;
+#endif
+	});
+	return frequency_ > 0.0;
+}
+
+profiling::clock::rep profiling::clock::tsc_now() {
+#ifdef DAMOGRAN_PROFILING_TSC
+	unsigned int aux;
+	__extension__ typedef __int128 wide_t;
+	// signed, other cores may read slightly before the calibration
+	int64_t ticks = static_cast<int64_t>(__rdtscp(&aux) - base_ticks_);
+	return base_ns_ + static_cast<rep>((static_cast<wide_t>(ticks) * mult_) >> 32);
+#else
+	return std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+bool profiling::clock::use(source s) {
+	// the calibration is read without synchronization and cannot be
+	// redone, so a drifted counter stays off
+	if (s == tsc && (drifted_.load() || !calibrate())) return false;
+	source_.store(s, std::memory_order_release);
+	return true;
+}
+
+profiling::clock::source profiling::clock::current() {
+	return static_cast<source>(source_.load(std::memory_order_relaxed));
+}
+
+double profiling::clock::frequency() {
+	return calibrate() ? frequency_ : 0.0;
+}
+
+bool profiling::clock::check() {
+	if (current() != tsc) return true;
+	auto steady_ns = [] { return std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()).count(); };
+	rep before = steady_ns();
+	rep ticked = now().time_since_epoch().count();
+	rep after = steady_ns();
+
+	// allow for the calibration error of the frequency, 0.1% of the time
+	// since the calibration
+	rep reference = before + (after - before) / 2;
+	rep tolerance = 10000 + (after - before) + (reference - base_ns_) / 1000;
+	if (std::abs(ticked - reference) <= tolerance) return true;
+	drifted_.store(true);
+	source_.store(steady, std::memory_order_release);
+	return false;
+}
+
+void profiling::scope::open(profiling& instance, id_t id) {
+	buffer_ = instance.local(true);
+	if (buffer_ && buffer_->suppressed) buffer_ = nullptr;
+	if (buffer_) {
+		depth_ = buffer_->stack.size();
+		suppressing_ = false;
+		buffer_->enter(id, 1);
+	}
+}
+
+void profiling::scope::open(profiling& instance, id_t id, uint32_t period, uint32_t& countdown) {
+	buffer_ = instance.local(true);
+	if (!buffer_) return;
+	depth_ = buffer_->stack.size();
+	suppressing_ = false;
+	if (buffer_->suppressed || --countdown) {
+		// unsampled pass, also skips the scopes nested in it
+		++buffer_->suppressed;
+		suppressing_ = true;
+		return;
+	}
+	countdown = period ? period : 1;
+	buffer_->enter(id, countdown);
+}
+
+void profiling::scope::close() {
+	if (suppressing_) {
+		--buffer_->suppressed;
+		return;
+	}
+	// also closes profiles started inside the scope and left open
+	time_point_t now = clock_t::now();
+	while (buffer_->stack.size() > depth_) buffer_->leave(now);
+}
+
+profiling& profiling::global() {
+	static profiling instance;
+	return instance;
+}
+
+profiling::id_t profiling::id(const std::string& name) {
+	// per-thread cache, so known names never touch the shared registry
+	thread_local std::unordered_map<std::string, id_t> cache;
+	auto found = cache.find(name);
+	if (found != cache.end()) return found->second;
+
+	unaccounted pause;
+	name_registry& registry = names();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	auto inserted = registry.ids.insert(std::make_pair(name, static_cast<id_t>(registry.names.size())));
+	if (inserted.second) registry.names.push_back(name);
+	cache[name] = inserted.first->second;
+	return inserted.first->second;
+}
+
+profiling::id_t profiling::id(const char* name) {
+	return id(std::string(name));
+}
+
+std::string profiling::name(id_t id) {
+	name_registry& registry = names();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return id < registry.names.size() ? registry.names[id] : std::string();
+}
+
+struct profiling::registrations {
+	~registrations() {
+		thread_exiting = true;
+		cached_serial_ = 0;
+		cached_buffer_ = nullptr;
+		allocating_ = nullptr;
+		instance_registry& registry = instances();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		for (const auto& entry : known) {
+			auto found = registry.instances.find(entry.first);
+			if (found != registry.instances.end()) found->second->retire(*entry.second);
+		}
+	}
+
+	// serials are never reused, so entries of destroyed instances never match
+	std::vector<std::pair<uint64_t, thread_buffer*>> known;
+};
+
+void profiling::retire(thread_buffer& buffer) {
+	unaccounted pause;
+	// profiles left running end with the thread
+	time_point_t now = clock_t::now();
+	while (buffer.stack.size() > 1) buffer.leave(now);
+
+	std::lock_guard<std::mutex> trace_lock(trace_mutex_);
+	// events of the thread are written before the buffer changes hands
+	if (trace_file_) write_trace();
+	if (buffer.index < trace_named_.size()) trace_named_[buffer.index] = false;
+
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	bool wanted = buffer.counters_wanted.load();
+	buffer.counters_wanted = false;
+	buffer.update_counters();
+	buffer.counters_wanted = wanted;
+	if (!exited_) {
+		threads_.emplace_back(new thread_buffer(thread_buffer::exited));
+		exited_ = threads_.back().get();
+	}
+	if (exited_threads_ < max_exited_threads) {
+		++exited_threads_;
+		for (uint32_t child = buffer.at(0).first_child; child != thread_buffer::none; child = buffer.at(child).next_sibling) {
+			node& n = buffer.at(child);
+			uint64_t calls = n.calls.load(std::memory_order_relaxed) - n.reported_calls;
+			if (calls) exited_totals_.push_back(exited_total{buffer.index, buffer.thread_id, n.id, n.inclusive.load(std::memory_order_relaxed) - n.reported_inclusive, calls});
+		}
+	}
+	exited_->absorb(buffer);
+	buffer.reset();
+	free_.push_back(&buffer);
+}
+
+profiling::thread_buffer* profiling::lookup(bool create) {
+	if (thread_exiting) return nullptr;
+	thread_local registrations registered;
+	std::vector<std::pair<uint64_t, thread_buffer*>>& known = registered.known;
+	for (const auto& entry : known) {
+		if (entry.first == serial_) {
+			cached_serial_ = serial_;
+			cached_buffer_ = entry.second;
+			return entry.second;
+		}
+	}
+	if (!create) return nullptr;
+
+	unaccounted pause;
+	thread_buffer* buffer;
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		if (free_.empty()) {
+			threads_.emplace_back(new thread_buffer(threads_.size()));
+			buffer = threads_.back().get();
+		} else {
+			buffer = free_.back();
+			free_.pop_back();
+			buffer->thread_id = current_thread_id();
+		}
+		if (trace_capacity_.load()) attach_trace(*buffer);
+		buffer->counters_wanted = counters_enabled_.load();
+	}
+	known.push_back(std::make_pair(serial_, buffer));
+	cached_serial_ = serial_;
+	cached_buffer_ = buffer;
+	return buffer;
+}
+
+profiling::histogram::histogram() : buckets_(bucket_count, 0), count_(0), min_(~uint64_t(0)), max_(0), sum_(0.0) {
+}
+
+uint64_t profiling::histogram::lower_bound(std::size_t bucket) {
+	if (bucket < linear_buckets) return bucket;
+	unsigned exponent = static_cast<unsigned>(5 + (bucket - linear_buckets) / sub_buckets);
+	return (sub_buckets + (bucket - linear_buckets) % sub_buckets) << (exponent - 4);
+}
+
+uint64_t profiling::histogram::upper_bound(std::size_t bucket) {
+	if (bucket + 1 == bucket_count) return ~uint64_t(0);
+	return lower_bound(bucket + 1);
+}
+
+void profiling::histogram::record(uint64_t ns, uint64_t count) {
+	if (!count) return;
+	buckets_[bucket(ns)] += count;
+	count_ += count;
+	min_ = std::min(min_, ns);
+	max_ = std::max(max_, ns);
+	sum_ += static_cast<double>(ns) * count;
+}
+
+void profiling::histogram::merge(const histogram& other) {
+	for (std::size_t b = 0; b < bucket_count; ++b) buckets_[b] += other.buckets_[b];
+	count_ += other.count_;
+	min_ = std::min(min_, other.min_);
+	max_ = std::max(max_, other.max_);
+	sum_ += other.sum_;
+}
+
+uint64_t profiling::histogram::count() const {
+	return count_;
+}
+
+uint64_t profiling::histogram::min() const {
+	return count_ ? min_ : 0;
+}
+
+uint64_t profiling::histogram::max() const {
+	return max_;
+}
+
+double profiling::histogram::mean() const {
+	return count_ ? sum_ / count_ : 0.0;
+}
+
+uint64_t profiling::histogram::percentile(double p) const {
+	if (!count_) return 0;
+	uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(p, 0.0), 100.0) / 100.0 * count_));
+	rank = std::max(rank, uint64_t(1));
+	uint64_t seen = 0;
+	std::size_t b = 0;
+	for (; b + 1 < bucket_count; ++b) {
+		seen += buckets_[b];
+		if (seen >= rank) break;
+	}
+	// middle of the bucket, but never outside of the recorded range
+	uint64_t lower = lower_bound(b);
+	uint64_t value = b + 1 < bucket_count ? lower + (upper_bound(b) - lower) / 2 : max_;
+	return std::min(std::max(value, min()), max_);
+}
+
+const std::vector<uint64_t>& profiling::histogram::buckets() const {
+	return buckets_;
+}
+
+profiling::histogram profiling::delta(node& n, bool consume) {
+	histogram h;
+	if (n.reported_buckets.empty()) {
+		n.reported_buckets.assign(histogram::bucket_count, 0);
+	}
+	std::size_t first = histogram::bucket_count, last = 0;
+	for (std::size_t b = 0; b < histogram::bucket_count; ++b) {
+		uint64_t count = n.buckets[b].load(std::memory_order_relaxed);
+		uint64_t added = count - n.reported_buckets[b];
+		if (consume) n.reported_buckets[b] = count;
+		if (!added) continue;
+		h.buckets_[b] = added;
+		h.count_ += added;
+		first = std::min(first, b);
+		last = b;
+	}
+	if (!h.count_) return h;
+	// exact extrema are only known since the first call, the buckets bound
+	// those of the new calls
+	h.min_ = std::max(n.min_ns.load(std::memory_order_relaxed), histogram::lower_bound(first));
+	h.max_ = std::min(n.max_ns.load(std::memory_order_relaxed), histogram::upper_bound(last) - 1);
+	h.sum_ = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration_t(n.inclusive.load(std::memory_order_relaxed) - n.reported_inclusive)).count());
+	return h;
+}
+
+void profiling::attach_trace(thread_buffer& buffer) {
+	if (buffer.index == thread_buffer::exited) return;
+	std::size_t capacity = trace_capacity_.load();
+	trace_ring* ring = buffer.rings.empty() ? nullptr : buffer.rings.back().get();
+	if (!ring || ring->events.size() < capacity) {
+		buffer.rings.emplace_back(new trace_ring(capacity));
+		ring = buffer.rings.back().get();
 	} else {
-		TimeInfo t;
-		t.start = clock_t::now();
-		t.passed = duration_t(0);
-		t.finished = false;
-		profiles_[name] = t;
+		// leftovers of a previous trace predate trace_start_ and are skipped
+		ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+		ring->reported_dropped = ring->dropped.load(std::memory_order_relaxed);
+	}
+	buffer.ring.store(ring, std::memory_order_release);
+}
+
+std::size_t profiling::write_trace() {
+	std::ofstream& out = *trace_file_;
+	const uint64_t pid = process_id();
+	const rep_t trace_start = trace_start_.time_since_epoch().count();
+	auto micros = [] (rep_t ticks) { return std::chrono::duration<double, std::micro>(duration_t(ticks)).count(); };
+	auto separator = [&] () -> const char* {
+		bool first = trace_first_;
+		trace_first_ = false;
+		return first ? "\n" : ",\n";
+	};
+	std::unordered_map<id_t, std::string> names;
+	char line[512];
+	std::size_t written = 0;
+
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	if (trace_named_.size() < threads_.size()) trace_named_.resize(threads_.size(), false);
+	for (const auto& buffer : threads_) {
+		if (buffer->rings.empty()) continue;
+		trace_ring& ring = *buffer->rings.back();
+		if (!trace_named_[buffer->index]) {
+			snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%llu,\"tid\":%llu,\"args\":{\"name\":\"thread %zu\"}}",
+				static_cast<unsigned long long>(pid), static_cast<unsigned long long>(buffer->thread_id), buffer->index);
+			out << separator() << line;
+			trace_named_[buffer->index] = true;
+		}
+
+		uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+		uint64_t head = ring.head.load(std::memory_order_acquire);
+		for (; tail != head; ++tail) {
+			const trace_event& event = ring.events[tail & ring.mask];
+			if (event.start < trace_start) continue;
+			auto found = names.find(event.id);
+			if (found == names.end()) found = names.insert(std::make_pair(event.id, json_escape(name(event.id)))).first;
+			snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":%llu,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}",
+				static_cast<unsigned long long>(pid), static_cast<unsigned long long>(buffer->thread_id), micros(event.start - trace_start), micros(event.duration));
+			out << separator() << "{\"name\":\"" << found->second << line;
+			++written;
+		}
+		ring.tail.store(head, std::memory_order_release);
+
+		uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+		if (dropped != ring.reported_dropped) {
+			// instant event at the time of the flush marking the gap
+			snprintf(line, sizeof(line), "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%llu,\"tid\":%llu,\"ts\":%.3f,\"args\":{\"count\":%llu}}",
+				static_cast<unsigned long long>(pid), static_cast<unsigned long long>(buffer->thread_id), micros((clock_t::now() - trace_start_).count()),
+				static_cast<unsigned long long>(dropped - ring.reported_dropped));
+			out << separator() << line;
+			ring.reported_dropped = dropped;
+		}
 	}
+	out.flush();
+	return written;
 }
 
-void profiling::end(std::string name) {
-	if (!profiles_.count(name)) return;
+void profiling::start(const std::string& name) {
+	if (!enabled()) return;
+	start(id(name));
+}
 
-	profiles_[name].passed += clock_t::now() - profiles_[name].start;
-	profiles_[name].finished = true;
+void profiling::end(const std::string& name) {
+	// profiles started before disabling still need to be ended
+	thread_buffer* buffer = local(false);
+	if (!buffer || buffer->stack.size() == 1) return;
+	end(id(name));
 }
 
-void profiling::profile(std::string name) {
-	if (profiles_.count(name) && !profiles_[name].finished) {
+void profiling::profile(const std::string& name) {
+	if (!enabled()) {
 		end(name);
+		return;
+	}
+	id_t profile = id(name);
+	thread_buffer* buffer = local(false);
+	bool running = false;
+	if (buffer) {
+		for (const frame& f : buffer->stack) running = running || buffer->at(f.node).id == profile;
+	}
+	if (running) {
+		end(profile);
 	} else {
-		start(name);
+		start(profile);
+	}
+}
+
+void profiling::start(id_t id) {
+	if (!enabled()) return;
+	thread_buffer* buffer = local(true);
+	if (buffer && !buffer->suppressed) buffer->enter(id, 1);
+}
+
+void profiling::end(id_t id) {
+	time_point_t now = clock_t::now();
+	thread_buffer* buffer = local(false);
+	if (!buffer) return;
+	std::size_t depth = buffer->stack.size();
+	while (depth > 1 && buffer->at(buffer->stack[depth - 1].node).id != id) --depth;
+	if (depth == 1) return;
+
+	if (buffer->stack.size() > depth) {
+		unaccounted pause;
+		std::lock_guard<std::mutex> lock(unfinished_mutex_);
+		for (std::size_t i = buffer->stack.size(); i-- > depth;) {
+			unfinished_.push_back(name(buffer->at(buffer->stack[i].node).id) + " (ended with " + name(id) + ")");
+		}
 	}
+	while (buffer->stack.size() >= depth) buffer->leave(now);
 }
 
 template <class DurationType>
 void profiling::summarize(std::function<void (std::string)> logFunction) {
-	if (!profiles_.size()) return;
 	std::function<void (std::string)> log = logFunction ? std::move(logFunction) : [&] (std::string msg) { std::cout << msg << "\n"; };
 
-	for (auto it = profiles_.begin(); it != profiles_.end(); ++it) {
-		if (!(*it).second.finished) {
-			log("Unfinished profile block: " + (*it).first);
-			end((*it).first);
+	// profiles of the calling thread are ended like before, the others can
+	// only be reported
+	std::vector<std::string> unfinished;
+	{
+		std::lock_guard<std::mutex> lock(unfinished_mutex_);
+		unfinished.swap(unfinished_);
+	}
+	thread_buffer* own = local(false);
+	if (own) {
+		time_point_t now = clock_t::now();
+		while (own->stack.size() > 1) {
+			unfinished.push_back(name(own->at(own->stack.back().node).id));
+			own->leave(now);
 		}
 	}
 
+	// call trees of all threads merged by path, tree[0] is the root and
+	// children are stored after their parent
+	struct per_thread {
+		std::string label;
+		rep_t       inclusive;
+		uint64_t    calls;
+	};
+	struct merged {
+		std::string                         name;
+		std::size_t                         parent;
+		rep_t                               inclusive;
+		uint64_t                            calls;
+		uint64_t                            subtree_calls;
+		histogram                           latency;
+		counter_values                      counters;
+		uint32_t                            counter_mask;
+		allocation_values                   allocations;
+		std::vector<per_thread>             threads;
+		std::map<std::string, std::size_t>  children;
+	};
+	std::vector<merged> tree(1, merged{"", 0, 0, 0, 0, histogram(), counter_values(), 0, allocation_values(), {}, {}});
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		std::vector<exited_total> exited;
+		exited.swap(exited_totals_);
+		exited_threads_ = 0;
+		for (const auto& buffer : threads_) {
+			uint32_t size = buffer->size.load(std::memory_order_acquire);
+			std::vector<std::size_t> target(size, 0);
+			for (uint32_t i = 1; i < size; ++i) {
+				node& n = buffer->at(i);
+				std::string node_name = name(n.id);
+				std::size_t parent = target[n.parent];
+				auto found = tree[parent].children.find(node_name);
+				if (found == tree[parent].children.end()) {
+					target[i] = tree.size();
+					tree[parent].children[node_name] = tree.size();
+					tree.push_back(merged{node_name, parent, 0, 0, 0, histogram(), counter_values(), 0, allocation_values(), {}, {}});
+				} else {
+					target[i] = found->second;
+				}
+				if (buffer.get() != own && n.open.load(std::memory_order_relaxed)) {
+					unfinished.push_back(node_name + " (thread " + std::to_string(buffer->index) + ")");
+				}
+
+				rep_t inclusive = n.inclusive.load(std::memory_order_relaxed);
+				uint64_t calls = n.calls.load(std::memory_order_relaxed);
+				if (calls == n.reported_calls) continue;
+				merged& m = tree[target[i]];
+				m.latency.merge(delta(n, true));
+				for (int c = 0; c < counter_count; ++c) {
+					uint64_t value = n.counters[c].load(std::memory_order_relaxed);
+					if (value == n.reported_counters[c]) continue;
+					m.counters[c] += value - n.reported_counters[c];
+					m.counter_mask |= buffer->counter_mask.load(std::memory_order_relaxed);
+					n.reported_counters[c] = value;
+				}
+				uint64_t allocations = n.allocations.load(std::memory_order_relaxed);
+				uint64_t allocated_bytes = n.allocated_bytes.load(std::memory_order_relaxed);
+				m.allocations.count += allocations - n.reported_allocations;
+				m.allocations.bytes += allocated_bytes - n.reported_allocated_bytes;
+				m.allocations.peak_bytes = std::max(m.allocations.peak_bytes, n.peak_bytes.load(std::memory_order_relaxed));
+				n.reported_allocations = allocations;
+				n.reported_allocated_bytes = allocated_bytes;
+				m.inclusive += inclusive - n.reported_inclusive;
+				m.calls += calls - n.reported_calls;
+				if (buffer.get() != exited_) {
+					m.threads.push_back(per_thread{"[thread " + std::to_string(buffer->index) + "]", inclusive - n.reported_inclusive, calls - n.reported_calls});
+				} else {
+					// exited threads kept apart, the rest stays summed
+					rep_t rest_inclusive = inclusive - n.reported_inclusive;
+					uint64_t rest_calls = calls - n.reported_calls;
+					for (const auto& total : exited) {
+						if (n.parent || total.id != n.id) continue;
+						m.threads.push_back(per_thread{"[thread " + std::to_string(total.thread) + ", tid " + std::to_string(total.thread_id) + ", exited]", total.inclusive, total.calls});
+						rest_inclusive -= total.inclusive;
+						rest_calls -= total.calls;
+					}
+					if (rest_calls) m.threads.push_back(per_thread{"[exited threads]", rest_inclusive, rest_calls});
+				}
+				n.reported_inclusive = inclusive;
+				n.reported_calls = calls;
+			}
+		}
+	}
+	for (std::size_t i = tree.size(); i-- > 1;) {
+		tree[i].subtree_calls += tree[i].calls;
+		tree[tree[i].parent].subtree_calls += tree[i].subtree_calls;
+	}
+	if (!tree[0].subtree_calls && unfinished.empty()) return;
+
+	for (const auto& name : unfinished) {
+		log("Unfinished profile block: " + name);
+	}
+
 	// print empty lines before summary
 	log("");
 	log("profiling summary");
 
 	typedef typename DurationType::rep Rep;
-	Rep overall(0);
-	for (auto it = profiles_.begin(); it != profiles_.end(); ++it) {
-		Rep duration = std::chrono::duration_cast<DurationType>(it->second.passed).count();
-		overall += duration;
-		log(format<DurationType>(it->first, duration));
-		//double fraction = (double)(duration.total_microseconds()) / profileSpan.get().length().total_microseconds();
-	}
+	auto cast = [] (rep_t duration) { return std::chrono::duration_cast<DurationType>(duration_t(duration)).count(); };
+	for (const auto& root : tree[0].children) tree[0].inclusive += tree[root.second].inclusive;
+	std::function<void (std::size_t, std::size_t)> print = [&] (std::size_t parent, std::size_t depth) {
+		const std::string indent(2 * depth, ' ');
+		for (const auto& child : tree[parent].children) {
+			const merged& m = tree[child.second];
+			if (!m.subtree_calls) continue;
+			rep_t nested(0);
+			for (const auto& grandchild : m.children) nested += tree[grandchild.second].inclusive;
+			// a profile still running in the parent leaves the parent without time
+			double percent = tree[parent].inclusive > 0 ? 100.0 * m.inclusive / tree[parent].inclusive : -1.0;
+			log(format<DurationType>(indent + m.name, cast(m.inclusive), cast(std::max(m.inclusive - nested, rep_t(0))), m.calls, percent));
+			if (m.calls) log("    " + indent + format<DurationType>(m.latency));
+			if (m.counter_mask) log("    " + indent + format(m.counters, m.counter_mask));
+			if (m.allocations.count || m.allocations.peak_bytes) log("    " + indent + format(m.allocations));
+			if (m.threads.size() > 1) {
+				for (const auto& thread : m.threads) {
+					log(format<DurationType>(indent + "  " + thread.label, cast(thread.inclusive)) + "  " + std::to_string(thread.calls) + " calls");
+				}
+			}
+			print(child.second, depth + 1);
+		}
+	};
+	print(0, 0);
+	Rep overall = cast(tree[0].inclusive);
 	log(format<DurationType>("Summed: ", overall));
+	if (!clock::check()) log("Time stamp counter drifted from steady_clock, profiling with steady_clock from now on");
 	log("Finished summary");
-	profiles_.clear();
 }
 
 template <class DurationType>
-typename DurationType::rep profiling::duration(std::string profile) const {
-	auto findIt = profiles_.find(profile);
-	if (findIt == profiles_.end()) {
-		return typename DurationType::rep(0);
+typename DurationType::rep profiling::duration(const std::string& profile) const {
+	id_t profile_id = id(profile);
+	rep_t passed(0);
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	for (const auto& buffer : threads_) {
+		uint32_t size = buffer->size.load(std::memory_order_acquire);
+		for (uint32_t i = 1; i < size; ++i) {
+			const node& n = buffer->at(i);
+			if (n.id != profile_id) continue;
+			// recursive calls are contained in the outermost one
+			bool nested = false;
+			for (uint32_t p = n.parent; p != 0 && !nested; p = buffer->at(p).parent) {
+				nested = buffer->at(p).id == profile_id;
+			}
+			if (!nested) passed += n.inclusive.load(std::memory_order_relaxed) - n.reported_inclusive;
+		}
 	}
-	return std::chrono::duration_cast<DurationType>(findIt->second.passed).count();
+	return std::chrono::duration_cast<DurationType>(duration_t(passed)).count();
 }
 
-#else
+profiling::histogram profiling::distribution(const std::string& profile) const {
+	id_t profile_id = id(profile);
+	histogram merged;
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	for (const auto& buffer : threads_) {
+		uint32_t size = buffer->size.load(std::memory_order_acquire);
+		for (uint32_t i = 1; i < size; ++i) {
+			node& n = buffer->at(i);
+			if (n.id != profile_id) continue;
+			bool nested = false;
+			for (uint32_t p = n.parent; p != 0 && !nested; p = buffer->at(p).parent) {
+				nested = buffer->at(p).id == profile_id;
+			}
+			if (!nested) merged.merge(delta(n, false));
+		}
+	}
+	return merged;
+}
 
-void profiling::start(std::string) {
+void profiling::start_trace(const std::string& path, std::size_t events_per_thread) {
+	stop_trace();
+	std::lock_guard<std::mutex> trace_lock(trace_mutex_);
+	trace_file_.reset(new std::ofstream(path));
+	if (!*trace_file_) {
+		trace_file_.reset();
+		throw std::runtime_error("profiling::start_trace: Unable to open trace file \"" + path + "\".");
+	}
+	*trace_file_ << "{\"traceEvents\":[";
+	trace_first_ = true;
+	trace_start_ = clock_t::now();
+	trace_capacity_ = std::max(events_per_thread, std::size_t(1));
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	trace_named_.assign(threads_.size(), false);
+	for (const auto& buffer : threads_) attach_trace(*buffer);
 }
 
-void profiling::end(std::string) {
+std::size_t profiling::flush_trace() {
+	std::lock_guard<std::mutex> trace_lock(trace_mutex_);
+	if (!trace_file_) return 0;
+	return write_trace();
 }
 
-void profiling::profile(std::string) {
+void profiling::stop_trace() {
+	std::lock_guard<std::mutex> trace_lock(trace_mutex_);
+	if (!trace_file_) return;
+	trace_capacity_ = 0;
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		for (const auto& buffer : threads_) buffer->ring.store(nullptr, std::memory_order_release);
+	}
+	write_trace();
+	*trace_file_ << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	trace_file_.reset();
 }
 
-template <class DurationType>
-void profiling::summarize(std::function<void (std::string)>) {
+bool profiling::enable_counters(bool enable) {
+	counters_enabled_ = enable;
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		for (const auto& buffer : threads_) buffer->counters_wanted = enable;
+	}
+	if (!enable) return false;
+	// probe on the calling thread, whose buffer only this thread touches
+	thread_buffer* own = local(true);
+	if (!own) return false;
+	own->update_counters();
+	counter_values values;
+	return own->read_counters(values);
 }
 
-template <class DurationType>
-typename DurationType::rep profiling::duration(std::string profile) const {
-	return typename DurationType::rep(0);
+profiling::counter_values profiling::counters(const std::string& profile) const {
+	id_t profile_id = id(profile);
+	counter_values values;
+	values.fill(0);
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	for (const auto& buffer : threads_) {
+		uint32_t size = buffer->size.load(std::memory_order_acquire);
+		for (uint32_t i = 1; i < size; ++i) {
+			const node& n = buffer->at(i);
+			if (n.id != profile_id) continue;
+			bool nested = false;
+			for (uint32_t p = n.parent; p != 0 && !nested; p = buffer->at(p).parent) {
+				nested = buffer->at(p).id == profile_id;
+			}
+			if (nested) continue;
+			for (int c = 0; c < counter_count; ++c) values[c] += n.counters[c].load(std::memory_order_relaxed) - n.reported_counters[c];
+		}
+	}
+	return values;
+}
+
+bool profiling::enable_allocations(bool enable) {
+#ifdef DAMOGRAN_PROFILING_ALLOCATIONS
+	allocations_enabled_.store(enable, std::memory_order_relaxed);
+	return enable;
+#else
+	(void) enable;
+	return false;
+#endif
+}
+
+profiling::allocation_values profiling::allocations(const std::string& profile) const {
+	id_t profile_id = id(profile);
+	allocation_values values{0, 0, 0};
+	std::lock_guard<std::mutex> lock(threads_mutex_);
+	for (const auto& buffer : threads_) {
+		uint32_t size = buffer->size.load(std::memory_order_acquire);
+		for (uint32_t i = 1; i < size; ++i) {
+			const node& n = buffer->at(i);
+			if (n.id != profile_id) continue;
+			// allocations are exclusive, so nested calls are added as well
+			values.count += n.allocations.load(std::memory_order_relaxed) - n.reported_allocations;
+			values.bytes += n.allocated_bytes.load(std::memory_order_relaxed) - n.reported_allocated_bytes;
+			values.peak_bytes = std::max(values.peak_bytes, n.peak_bytes.load(std::memory_order_relaxed));
+		}
+	}
+	return values;
 }
 
-#endif // PROFILING
 
 
 template <class DurationType>
 std::string profiling::format(std::string name, typename DurationType::rep duration) {
 	char output[255];
-	std::string format = "  %-25s%11d"+unit<DurationType>();//   %13.3f%%";
-	sprintf(output, format.c_str(), name.c_str(), duration); //, fraction*100.0);
+	std::string format = "  %-35s%11lld"+unit<DurationType>();
+	snprintf(output, sizeof(output), format.c_str(), name.c_str(), static_cast<long long>(duration));
+	std::string result(output);
+	return result;
+}
+
+template <class DurationType>
+std::string profiling::format(std::string name, typename DurationType::rep inclusive, typename DurationType::rep exclusive, uint64_t calls, double percent) {
+	char output[255];
+	std::string format = "%11lld"+unit<DurationType>()+" excl %9llu calls";
+	snprintf(output, sizeof(output), format.c_str(), static_cast<long long>(exclusive), static_cast<unsigned long long>(calls));
+	std::string result = profiling::format<DurationType>(name, inclusive) + output;
+	if (percent >= 0.0) {
+		snprintf(output, sizeof(output), " %6.1f%%", percent);
+		result += output;
+	}
+	return result;
+}
+
+template <class DurationType>
+std::string profiling::format(const histogram& latency) {
+	typedef std::chrono::duration<double, typename DurationType::period> fraction_t;
+	auto value = [] (double ns) { return std::chrono::duration_cast<fraction_t>(std::chrono::duration<double, std::nano>(ns)).count(); };
+	char output[255];
+	std::string u = unit<DurationType>();
+	std::string format = "min %.4g"+u+"  mean %.4g"+u+"  p50 %.4g"+u+"  p90 %.4g"+u+"  p99 %.4g"+u+"  p99.9 %.4g"+u+"  max %.4g"+u;
+	snprintf(output, sizeof(output), format.c_str(), value(latency.min()), value(latency.mean()), value(latency.percentile(50.0)), value(latency.percentile(90.0)), value(latency.percentile(99.0)), value(latency.percentile(99.9)), value(latency.max()));
+	std::string result(output);
+	return result;
+}
+
+std::string profiling::format(const counter_values& values, uint32_t mask) {
+	auto has = [&] (counter c) { return (mask >> c) & 1u; };
+	auto value = [&] (const char* label, counter c) {
+		char output[64];
+		snprintf(output, sizeof(output), "%s %.4g  ", label, static_cast<double>(values[c]));
+		return std::string(output);
+	};
+	auto ratio = [&] (const char* label, double numerator, double denominator, double scale) {
+		char output[64];
+		snprintf(output, sizeof(output), "%s %.3g  ", label, denominator > 0.0 ? scale * numerator / denominator : 0.0);
+		return std::string(output);
+	};
+	std::string result;
+	if (has(cycles)) result += value("cycles", cycles);
+	if (has(instructions)) result += value("instructions", instructions);
+	if (has(cycles) && has(instructions)) result += ratio("IPC", values[instructions], values[cycles], 1.0);
+	if (has(branch_misses)) result += value("branch misses", branch_misses);
+	if (has(branches) && has(branch_misses)) result += ratio("miss %", values[branch_misses], values[branches], 100.0);
+	// cache misses per thousand instructions
+	if (has(l1d_misses)) result += has(instructions) ? ratio("L1D MPKI", values[l1d_misses], values[instructions], 1000.0) : value("L1D misses", l1d_misses);
+	if (has(llc_misses)) result += has(instructions) ? ratio("LLC MPKI", values[llc_misses], values[instructions], 1000.0) : value("LLC misses", llc_misses);
+	if (has(context_switches)) result += value("context switches", context_switches);
+	return result.substr(0, result.size() - 2);
+}
+
+std::string profiling::format(const allocation_values& values) {
+	char output[255];
+	snprintf(output, sizeof(output), "allocations %llu  bytes %.4g  peak bytes %.4g", static_cast<unsigned long long>(values.count), static_cast<double>(values.bytes), static_cast<double>(values.peak_bytes));
 	std::string result(output);
 	return result;
 }
@@ -136,11 +1254,82 @@ std::string profiling::unit<std::chrono::nanoseconds>() {
 	return "ns";
 }
 
+#ifdef DAMOGRAN_PROFILING_ALLOCATIONS
+// accounting of the replaced global operators of new and delete, on the
+// allocating thread, which owns the buffer
+struct allocation_hooks {
+	static void allocated(std::size_t requested, void* pointer) {
+		if (!profiling::allocations_enabled_.load(std::memory_order_relaxed)) return;
+		profiling::thread_buffer* buffer = profiling::allocating_;
+		if (!buffer) return;
+		profiling::frame& top = buffer->stack.back();
+		profiling::node& n = buffer->at(top.node);
+		n.allocations.store(n.allocations.load(std::memory_order_relaxed) + top.weight, std::memory_order_relaxed);
+		n.allocated_bytes.store(n.allocated_bytes.load(std::memory_order_relaxed) + top.weight * requested, std::memory_order_relaxed);
+		// live bytes are counted as usable by malloc, which free releases
+		buffer->live += static_cast<int64_t>(malloc_usable_size(pointer));
+		if (buffer->live > top.live_peak) top.live_peak = buffer->live;
+	}
+
+	static void freed(void* pointer) {
+		if (!pointer || !profiling::allocations_enabled_.load(std::memory_order_relaxed)) return;
+		profiling::thread_buffer* buffer = profiling::allocating_;
+		if (!buffer) return;
+		buffer->live -= static_cast<int64_t>(malloc_usable_size(pointer));
+	}
+};
+#endif
+
 
 } // damogran
 
 
 #define X(type) \
-	template void      damogran::profiling::summarize<type>(std::function<void (std::string)>) const; \
-	template type::rep damogran::profiling::duration(std::string) const;
+	template void      damogran::profiling::summarize<type>(std::function<void (std::string)>); \
+	template type::rep damogran::profiling::duration<type>(const std::string&) const;
+DURATION_TYPES
 #undef X
+
+#ifdef DAMOGRAN_PROFILING_ALLOCATIONS
+namespace {
+
+void* allocate(std::size_t size) {
+	for (;;) {
+		void* pointer = std::malloc(size ? size : 1);
+		if (pointer) {
+			damogran::allocation_hooks::allocated(size, pointer);
+			return pointer;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* allocate(std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void deallocate(void* pointer) noexcept {
+	// accounted before the memory may be reused by another thread
+	damogran::allocation_hooks::freed(pointer);
+	std::free(pointer);
+}
+
+} // anonymous
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, tag); }
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, tag); }
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { deallocate(pointer); }
+#endif
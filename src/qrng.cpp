@@ -0,0 +1,333 @@
+/*
+ * damogran - c++ opengl wrapper library
+ *
+ * Written in 2014 by Richard Vock
+ *
+ * To the extent possible under law, the author(s) have dedicated all copyright and related and neighboring rights to this software to the public domain worldwide.
+ * This software is distributed without any warranty.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with this software.
+ * If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ *
+ */
+
+#include <qrng.hpp>
+#include <parallel.hpp>
+#include <rng_engines.hpp>
+
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+namespace damogran {
+
+
+namespace {
+
+// points per parallel chunk
+constexpr std::size_t point_chunk = 4096;
+
+// [0, 1) from the top 24 bits
+inline float to_float(uint32_t bits) {
+	return float(bits >> 8) * (1.f / 16777216.f);
+}
+
+inline float to_float(uint64_t bits) {
+	return float(bits >> 40) * (1.f / 16777216.f);
+}
+
+// Joe and Kuo, new-joe-kuo-6.21201, dimensions 2-21: degree s, polynomial
+// coefficients a and initial direction numbers m_1, ..., m_s.
+struct joe_kuo_entry {
+	uint32_t s;
+	uint32_t a;
+	uint32_t m[7];
+};
+
+const joe_kuo_entry joe_kuo[] = {
+	{1,  0, {1}},
+	{2,  1, {1, 3}},
+	{3,  1, {1, 3, 1}},
+	{3,  2, {1, 1, 1}},
+	{4,  1, {1, 1, 3, 3}},
+	{4,  4, {1, 3, 5, 13}},
+	{5,  2, {1, 1, 5, 5, 17}},
+	{5,  4, {1, 1, 5, 5, 5}},
+	{5,  7, {1, 1, 7, 11, 19}},
+	{5, 11, {1, 1, 5, 1, 1}},
+	{5, 13, {1, 1, 1, 3, 11}},
+	{5, 14, {1, 3, 5, 5, 31}},
+	{6,  1, {1, 3, 3, 9, 7, 49}},
+	{6, 13, {1, 1, 1, 15, 21, 21}},
+	{6, 16, {1, 3, 1, 13, 27, 49}},
+	{6, 19, {1, 1, 1, 15, 7, 5}},
+	{6, 22, {1, 3, 1, 15, 13, 25}},
+	{6, 25, {1, 1, 5, 5, 19, 61}},
+	{7,  1, {1, 3, 7, 11, 23, 15, 103}},
+	{7,  4, {1, 3, 7, 13, 13, 15, 69}}
+};
+constexpr uint32_t joe_kuo_dimensions = 1 + sizeof(joe_kuo) / sizeof(joe_kuo[0]);
+
+// x^e mod p over GF(2), p of degree s < 32
+uint64_t gf2_pow_x(uint64_t e, uint64_t p, uint32_t s) {
+	auto mul = [&] (uint64_t a, uint64_t b) {
+		uint64_t r = 0;
+		for (uint32_t i = 0; i < s; ++i) {
+			if (b & (uint64_t(1) << i)) r ^= a;
+			a <<= 1;
+			if (a & (uint64_t(1) << s)) a ^= p;
+		}
+		return r;
+	};
+	uint64_t result = 1, base = s == 1 ? 1 : 2;   // x mod p
+	for (; e; e >>= 1) {
+		if (e & 1) result = mul(result, base);
+		base = mul(base, base);
+	}
+	return result;
+}
+
+// x^s + a_1 x^(s-1) + ... + a_(s-1) x + 1 with a's bits a_1 ... a_(s-1)
+bool primitive(uint32_t s, uint32_t a) {
+	uint64_t p = (uint64_t(1) << s) | (uint64_t(a) << 1) | 1;
+	uint64_t order = (uint64_t(1) << s) - 1;
+	if (gf2_pow_x(order, p, s) != 1) return false;
+	uint64_t rest = order;
+	for (uint64_t q = 2; q * q <= rest; ++q) {
+		if (rest % q) continue;
+		if (gf2_pow_x(order / q, p, s) == 1) return false;
+		while (rest % q == 0) rest /= q;
+	}
+	return rest == 1 || rest == order || gf2_pow_x(order / rest, p, s) != 1;
+}
+
+void sobol_directions(uint32_t s, uint32_t a, const uint32_t* m, uint32_t* v) {
+	for (uint32_t k = 0; k < s && k < 32; ++k) {
+		v[k] = m[k] << (31 - k);
+	}
+	for (uint32_t k = s; k < 32; ++k) {
+		v[k] = v[k - s] ^ (v[k - s] >> s);
+		for (uint32_t i = 1; i < s; ++i) {
+			if ((a >> (s - 1 - i)) & 1) v[k] ^= v[k - i];
+		}
+	}
+}
+
+std::vector<uint32_t> first_primes(uint32_t count) {
+	std::vector<uint32_t> primes;
+	for (uint32_t n = 2; primes.size() < count; ++n) {
+		bool prime = true;
+		for (uint32_t p : primes) {
+			if (p * p > n) break;
+			if (n % p == 0) { prime = false; break; }
+		}
+		if (prime) primes.push_back(n);
+	}
+	return primes;
+}
+
+} // anonymous
+
+
+quasi_sequence::quasi_sequence(uint32_t dimensions) : dimensions_(dimensions), position_(0) {
+	if (!dimensions) {
+		throw std::runtime_error("quasi_sequence: Zero dimensions.");
+	}
+}
+
+quasi_sequence::~quasi_sequence() {
+}
+
+uint32_t quasi_sequence::dimensions() const {
+	return dimensions_;
+}
+
+uint64_t quasi_sequence::position() const {
+	return position_;
+}
+
+void quasi_sequence::seek(uint64_t index) {
+	position_ = index;
+}
+
+void quasi_sequence::next(float* point) {
+	generate(position_++, 1, point);
+}
+
+void quasi_sequence::fill(span<float> points, unsigned int threads) {
+	if (points.size() % dimensions_) {
+		throw std::runtime_error("quasi_sequence::fill: Output size is not a multiple of the dimension count.");
+	}
+	std::size_t count = points.size() / dimensions_;
+	uint64_t first = position_;
+	parallel_chunks(count, point_chunk, [&] (std::size_t, std::size_t begin, std::size_t end) {
+		generate(first + begin, end - begin, points.data() + begin * dimensions_);
+	}, threads);
+	position_ += count;
+}
+
+
+sobol_sequence::sobol_sequence(uint32_t dimensions, uint64_t seed) : quasi_sequence(dimensions), directions_(32 * std::size_t(dimensions)) {
+	// the first dimension is van der Corput's sequence
+	for (uint32_t k = 0; k < 32; ++k) directions_[k] = uint32_t(1) << (31 - k);
+	uint32_t d = 1;
+	for (; d < dimensions && d < joe_kuo_dimensions; ++d) {
+		const joe_kuo_entry& e = joe_kuo[d - 1];
+		sobol_directions(e.s, e.a, e.m, &directions_[32 * d]);
+	}
+	// continue with the next primitive polynomials, as Joe and Kuo order them
+	uint64_t state = 0x5eed50b01ull;
+	uint32_t s = 7, a = 4;
+	for (; d < dimensions; ++d) {
+		do {
+			if (++a == (uint32_t(1) << (s - 1))) {
+				++s;
+				a = 0;
+			}
+			if (s > 31) {
+				throw std::runtime_error("sobol_sequence: Too many dimensions.");
+			}
+		} while (!primitive(s, a));
+		uint32_t m[32];
+		for (uint32_t k = 0; k < s && k < 32; ++k) {
+			m[k] = uint32_t(2 * (splitmix64(state) % (uint64_t(1) << k)) + 1);
+		}
+		sobol_directions(s, a, m, &directions_[32 * d]);
+	}
+	init_shift(seed);
+}
+
+sobol_sequence::sobol_sequence(uint32_t dimensions, std::istream& direction_file, uint64_t seed) : quasi_sequence(dimensions), directions_(32 * std::size_t(dimensions)) {
+	for (uint32_t k = 0; k < 32; ++k) directions_[k] = uint32_t(1) << (31 - k);
+	std::string line;
+	std::getline(direction_file, line);   // header
+	for (uint32_t d = 1; d < dimensions; ++d) {
+		if (!std::getline(direction_file, line)) {
+			throw std::runtime_error("sobol_sequence: Direction file has fewer dimensions than requested.");
+		}
+		std::istringstream in(line);
+		uint32_t dim, s, a;
+		in >> dim >> s >> a;
+		if (!in || s < 1 || s > 31) {
+			throw std::runtime_error("sobol_sequence: Malformed direction file.");
+		}
+		uint32_t m[32];
+		for (uint32_t k = 0; k < s; ++k) in >> m[k];
+		if (!in) {
+			throw std::runtime_error("sobol_sequence: Malformed direction file.");
+		}
+		sobol_directions(s, a, m, &directions_[32 * d]);
+	}
+	init_shift(seed);
+}
+
+sobol_sequence::~sobol_sequence() {
+}
+
+void sobol_sequence::init_shift(uint64_t seed) {
+	shift_.assign(dimensions_, 0);
+	if (!seed) return;
+	for (auto& shift : shift_) shift = uint32_t(splitmix64(seed) >> 32);
+}
+
+uint32_t sobol_sequence::point_bits(uint32_t dimension, uint64_t index) const {
+	uint32_t gray = uint32_t(index ^ (index >> 1));
+	const uint32_t* v = &directions_[32 * std::size_t(dimension)];
+	uint32_t x = 0;
+	for (; gray; gray &= gray - 1) {
+		x ^= v[__builtin_ctz(gray)];
+	}
+	return x;
+}
+
+// Gray code order: consecutive points differ in one direction number each.
+void sobol_sequence::generate(uint64_t first, std::size_t count, float* points) const {
+	std::vector<uint32_t> x(dimensions_);
+	for (uint32_t d = 0; d < dimensions_; ++d) x[d] = point_bits(d, first);
+	for (std::size_t i = 0; i < count; ++i) {
+		float* point = points + i * dimensions_;
+		for (uint32_t d = 0; d < dimensions_; ++d) {
+			point[d] = to_float(x[d] ^ shift_[d]);
+		}
+		uint32_t low = uint32_t(first + i + 1);
+		if (!low) continue;
+		const uint32_t* v = &directions_[__builtin_ctz(low)];
+		for (uint32_t d = 0; d < dimensions_; ++d) {
+			x[d] ^= v[32 * std::size_t(d)];
+		}
+	}
+}
+
+
+halton_sequence::halton_sequence(uint32_t dimensions, uint64_t seed) : quasi_sequence(dimensions), bases_(first_primes(dimensions)) {
+	if (bases_.back() > 65535) {
+		throw std::runtime_error("halton_sequence: Too many dimensions.");
+	}
+	if (!seed) return;
+	xoshiro256pp engine(seed);
+	for (uint32_t b : bases_) {
+		offsets_.push_back(uint32_t(permutations_.size()));
+		for (uint32_t digit = 0; digit < b; ++digit) permutations_.push_back(uint16_t(digit));
+		// Fisher-Yates over 1, ..., b - 1
+		uint16_t* perm = &permutations_[offsets_.back()];
+		for (uint32_t i = b - 1; i > 1; --i) {
+			uint32_t j = 1 + uint32_t((engine() >> 32) * i >> 32);
+			std::swap(perm[i], perm[j]);
+		}
+	}
+}
+
+halton_sequence::~halton_sequence() {
+}
+
+void halton_sequence::generate(uint64_t first, std::size_t count, float* points) const {
+	const float below_one = std::nextafter(1.f, 0.f);
+	for (std::size_t i = 0; i < count; ++i) {
+		float* point = points + i * dimensions_;
+		for (uint32_t d = 0; d < dimensions_; ++d) {
+			const uint64_t b = bases_[d];
+			const double inv = 1.0 / double(b);
+			const uint16_t* perm = permutations_.empty() ? nullptr : &permutations_[offsets_[d]];
+			double x = 0.0, f = inv;
+			for (uint64_t n = first + i; n; n /= b, f *= inv) {
+				uint64_t digit = n % b;
+				x += double(perm ? perm[digit] : digit) * f;
+			}
+			point[d] = std::min(float(x), below_one);
+		}
+	}
+}
+
+
+rd_sequence::rd_sequence(uint32_t dimensions, uint64_t seed) : quasi_sequence(dimensions), alpha_(dimensions), offset_(dimensions, uint64_t(1) << 63) {
+	long double phi = 2.0L;
+	for (int i = 0; i < 64; ++i) {
+		phi = std::pow(1.0L + phi, 1.0L / (long double)(dimensions + 1));
+	}
+	const long double two64 = 18446744073709551616.0L;
+	long double power = 1.0L;
+	for (uint32_t d = 0; d < dimensions; ++d) {
+		power /= phi;
+		long double fraction = power - std::floor(power);
+		alpha_[d] = uint64_t(fraction * two64);
+	}
+	if (seed) {
+		for (auto& offset : offset_) offset = splitmix64(seed);
+	}
+}
+
+rd_sequence::~rd_sequence() {
+}
+
+void rd_sequence::generate(uint64_t first, std::size_t count, float* points) const {
+	for (std::size_t i = 0; i < count; ++i) {
+		float* point = points + i * dimensions_;
+		for (uint32_t d = 0; d < dimensions_; ++d) {
+			point[d] = to_float(uint64_t(offset_[d] + (first + i) * alpha_[d]));
+		}
+	}
+}
+
+
+} // damogran
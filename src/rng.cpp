@@ -14,70 +14,535 @@
 #include <rng.hpp>
 #include <macros.hpp>
 
-#include <chrono> // for time seeding
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DAMOGRAN_RNG_X86
+#endif
 
 namespace damogran {
 
 
+constexpr std::size_t xoshiro256pp_x4::lanes;
+constexpr std::size_t philox4x32::batch;
+
+namespace {
+
+std::atomic<uint64_t> global_seed(0);
+std::atomic<uint32_t> global_epoch(0);   // 0: never seeded
+std::atomic<uint32_t> thread_count(0);
+
+struct thread_engine {
+	rng::internal_generator_t engine;
+	rng::bulk_generator_t bulk;
+	uint32_t index;
+	uint32_t epoch;
+	// bumped whenever engine is reseeded; bulk is reseeded from engine when
+	// bulk_generation falls behind
+	uint32_t generation;
+	uint32_t bulk_generation;
+
+	thread_engine() : index(thread_count++), epoch(0), generation(1), bulk_generation(0) {
+		std::random_device device;
+		std::seed_seq seq{device(), device(), device(), device(), index};
+		engine.seed(seq);
+	}
+
+	void reseed(uint64_t seed) {
+		std::seed_seq seq{uint32_t(seed), uint32_t(seed >> 32), index};
+		engine.seed(seq);
+		++generation;
+	}
+};
+
+thread_engine& local_engine() {
+	static thread_local thread_engine local;
+	return local;
+}
+
+} // anonymous
+
+namespace {
+
+// Layers of equal area v for the (unnormalized) density f, starting at
+// x[1] = r. r and v are Marsaglia and Tsang's constants for 256 layers.
+template <class Density, class Inverse>
+void build_ziggurat(detail::ziggurat& z, double r, double v, Density&& f, Inverse&& inverse) {
+	z.x[0] = v / f(r);
+	z.x[1] = r;
+	for (int i = 1; i < 255; ++i) {
+		z.x[i + 1] = inverse(v / z.x[i] + f(z.x[i]));
+	}
+	z.x[256] = 0.0;
+	for (int i = 0; i < 257; ++i) {
+		z.f[i] = f(z.x[i]);
+	}
+}
+
+} // anonymous
+
+const detail::ziggurat& detail::ziggurat::normal() {
+	static const ziggurat table = [] () {
+		ziggurat z;
+		build_ziggurat(z, 3.6541528853610088, 0.00492867323399,
+			[] (double x) { return std::exp(-0.5 * x * x); },
+			[] (double y) { return std::sqrt(-2.0 * std::log(y)); });
+		return z;
+	}();
+	return table;
+}
+
+const detail::ziggurat& detail::ziggurat::exponential() {
+	static const ziggurat table = [] () {
+		ziggurat z;
+		build_ziggurat(z, 7.69711747013104972, 0.0039496598225815571993,
+			[] (double x) { return std::exp(-x); },
+			[] (double y) { return -std::log(y); });
+		return z;
+	}();
+	return table;
+}
+
+rng::internal_generator_t& rng::engine() {
+	thread_engine& local = local_engine();
+	uint32_t epoch = global_epoch.load(std::memory_order_acquire);
+	if (epoch != local.epoch) {
+		local.epoch = epoch;
+		local.reseed(global_seed.load(std::memory_order_relaxed));
+	}
+	return local.engine;
+}
+
+void rng::seed(uint64_t seed) {
+	global_seed.store(seed, std::memory_order_relaxed);
+	// concurrent calls must not lose a bump, and 0 is skipped so seeded
+	// engines never look unseeded
+	uint32_t epoch = global_epoch.load(std::memory_order_relaxed);
+	while (!global_epoch.compare_exchange_weak(epoch, epoch + 1 ? epoch + 1 : 1, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+}
+
+void rng::seed_thread(uint64_t seed) {
+	thread_engine& local = local_engine();
+	local.epoch = global_epoch.load(std::memory_order_acquire);
+	std::seed_seq seq{uint32_t(seed), uint32_t(seed >> 32)};
+	local.engine.seed(seq);
+	++local.generation;
+}
+
+rng::bulk_generator_t& rng::bulk_engine() {
+	internal_generator_t& source = engine();
+	thread_engine& local = local_engine();
+	if (local.bulk_generation != local.generation) {
+		local.bulk_generation = local.generation;
+		local.bulk.seed((uint64_t(source()) << 32) | source());
+	}
+	return local.bulk;
+}
+
 template <class T>
 T rng::uniform_01() {
-	auto gen = uniform_01_gen<T>();
-	return gen();
+	typename traits_t<T>::dist_01_t dist(T(0), T(1));
+	return dist(engine());
 }
 
 template <class T>
 T rng::uniform_ab(T a, T b) {
-	auto gen = uniform_ab_gen<T>(a, b);
-	return gen();
+	typename traits_t<T>::dist_ab_t dist( a, traits_t<T>::upper_bound(b, std::is_floating_point<T>()) );
+	return dist(engine());
 }
 
 template <class T>
 T rng::geometric(float p) {
-	auto gen = geometric_gen<T>(p);
-	return gen();
+	typename traits_t<T>::dist_geom_t dist(p);
+	return dist(engine());
 }
 
 template <class T>
 T rng::normal(T mean, T std_dev) {
-	auto gen = normal_gen<T>(mean, std_dev);
-	return gen();
+	return mean + std_dev * T(detail::ziggurat_normal(detail::ziggurat::normal(), engine()));
+}
+
+template <class T>
+T rng::exponential(T lambda) {
+	return T(detail::ziggurat_exponential(detail::ziggurat::exponential(), engine())) / lambda;
 }
 
 template <class T>
 typename rng::traits_t<T>::generator_t rng::uniform_01_gen(bool deterministic) {
-	auto gen = generator(deterministic);
-	typename traits_t<T>::dist_01_t dist(T(0), T(1));
-	return std::bind(dist, gen);
+	return uniform_01_engine<T, internal_generator_t>(generator(deterministic));
 }
 
 template <class T>
 typename rng::traits_t<T>::generator_t rng::uniform_ab_gen(T a, T b, bool deterministic) {
-	// uniform_real gives [a,b) and uniform_int [a,b];
-	// upper_bound(b, ...) is b-1 for is_floating_point<T> == false_type
-	auto gen = generator(deterministic);
-	typename traits_t<T>::dist_ab_t dist( a, traits_t<T>::upper_bound(b, std::is_floating_point<T>()) );
-	return std::bind(dist, gen);
+	return uniform_ab_engine<T, internal_generator_t>(a, b, generator(deterministic));
 }
 
 template <class T>
 typename rng::traits_t<T>::generator_t rng::geometric_gen(float p, bool deterministic) {
-	auto gen = generator(deterministic);
-	typename traits_t<T>::dist_geom_t dist(p);
-	return std::bind(dist, gen);
+	return geometric_engine<T, internal_generator_t>(p, generator(deterministic));
 }
 
 template <class T>
 typename rng::traits_t<T>::generator_t rng::normal_gen(T mean, T std_dev, bool deterministic) {
-	auto gen = generator(deterministic);
-	typename traits_t<T>::dist_normal_t dist(mean, std_dev);
-	return std::bind(dist, gen);
+	return normal_engine<T, internal_generator_t>(mean, std_dev, generator(deterministic));
+}
+
+template <class T>
+typename rng::traits_t<T>::generator_t rng::exponential_gen(T lambda, bool deterministic) {
+	return exponential_engine<T, internal_generator_t>(lambda, generator(deterministic));
+}
+
+namespace {
+
+// raw draws (64 bit) per block of a bulk fill
+constexpr std::size_t fill_block = 256;
+
+#ifdef DAMOGRAN_RNG_X86
+__attribute__((target("avx2")))
+inline __m256i rotl_avx2(__m256i x, int k) {
+	return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+// same step as xoshiro256pp_x4::fill with all four lanes in one register
+__attribute__((target("avx2")))
+void fill_raw_avx2(uint64_t* state, uint64_t* out, std::size_t n) {
+	__m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state));
+	__m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 4));
+	__m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 8));
+	__m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 12));
+	for (std::size_t i = 0; i < n; i += 4) {
+		__m256i result = _mm256_add_epi64(rotl_avx2(_mm256_add_epi64(s0, s3), 23), s0);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+		__m256i t = _mm256_slli_epi64(s1, 17);
+		s2 = _mm256_xor_si256(s2, s0);
+		s3 = _mm256_xor_si256(s3, s1);
+		s1 = _mm256_xor_si256(s1, s2);
+		s0 = _mm256_xor_si256(s0, s3);
+		s2 = _mm256_xor_si256(s2, t);
+		s3 = rotl_avx2(s3, 45);
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state), s0);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 4), s1);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 8), s2);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 12), s3);
+}
+// Philox4x32-10 on eight counters at once, as two independent groups of
+// four to hide the multiply latency. Every 32 bit word is zero-extended into
+// a 64 bit lane so that _mm256_mul_epu32 yields the full products. Writes n
+// draws (n a multiple of 16) starting at block `first`.
+__attribute__((target("avx2")))
+void philox_avx2(const rng::stream_generator_t& engine, uint64_t first, uint64_t* out, std::size_t n) {
+	const __m256i low = _mm256_set1_epi64x(0xffffffffll);
+	const __m256i m0 = _mm256_set1_epi64x(0xd2511f53ll);
+	const __m256i m1 = _mm256_set1_epi64x(0xcd9e8d57ll);
+	const __m256i stream_lo = _mm256_set1_epi64x(uint32_t(engine.stream()));
+	const __m256i stream_hi = _mm256_set1_epi64x(uint32_t(engine.stream() >> 32));
+	const uint32_t key0 = uint32_t(engine.seed()), key1 = uint32_t(engine.seed() >> 32);
+	for (std::size_t i = 0; i < n; i += 16) {
+		__m256i c0[2], c1[2], c2[2], c3[2];
+		for (int g = 0; g < 2; ++g) {
+			uint64_t b = first + i / 2 + 4 * g;
+			__m256i block = _mm256_setr_epi64x(b, b + 1, b + 2, b + 3);
+			c0[g] = _mm256_and_si256(block, low);
+			c1[g] = _mm256_srli_epi64(block, 32);
+			c2[g] = stream_lo;
+			c3[g] = stream_hi;
+		}
+		uint32_t k0 = key0, k1 = key1;
+		for (int r = 0; r < 10; ++r) {
+			const __m256i key_0 = _mm256_set1_epi64x(k0);
+			const __m256i key_1 = _mm256_set1_epi64x(k1);
+			for (int g = 0; g < 2; ++g) {
+				__m256i p0 = _mm256_mul_epu32(c0[g], m0);
+				__m256i p1 = _mm256_mul_epu32(c2[g], m1);
+				c0[g] = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), c1[g]), key_0);
+				c1[g] = _mm256_and_si256(p1, low);
+				c2[g] = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), c3[g]), key_1);
+				c3[g] = _mm256_and_si256(p0, low);
+			}
+			k0 += 0x9e3779b9u;
+			k1 += 0xbb67ae85u;
+		}
+		for (int g = 0; g < 2; ++g) {
+			__m256i x01 = _mm256_or_si256(c0[g], _mm256_slli_epi64(c1[g], 32));
+			__m256i x23 = _mm256_or_si256(c2[g], _mm256_slli_epi64(c3[g], 32));
+			__m256i lo = _mm256_unpacklo_epi64(x01, x23);
+			__m256i hi = _mm256_unpackhi_epi64(x01, x23);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 8 * g), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 8 * g + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+	}
+}
+#endif // DAMOGRAN_RNG_X86
+
+void fill_raw(rng::stream_generator_t& engine, uint64_t* out, std::size_t n) {
+#ifdef DAMOGRAN_RNG_X86
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		std::size_t i = 0;
+		if (n && engine.offset() % 2) out[i++] = engine();
+		std::size_t vectorized = (n - i) / 16 * 16;
+		philox_avx2(engine, engine.offset() / 2, out + i, vectorized);
+		engine.discard(vectorized);
+		i += vectorized;
+		engine.fill(out + i, n - i);
+		return;
+	}
+#endif
+	engine.fill(out, n);
+}
+
+// n is rounded up to a multiple of the engine's lanes; out must have room
+void fill_raw(rng::bulk_generator_t& engine, uint64_t* out, std::size_t n) {
+	n = (n + rng::bulk_generator_t::lanes - 1) / rng::bulk_generator_t::lanes * rng::bulk_generator_t::lanes;
+#ifdef DAMOGRAN_RNG_X86
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		fill_raw_avx2(engine.state(), out, n);
+		return;
+	}
+#endif
+	engine.fill(out, n);
+}
+
+void unpack32(const uint64_t* raw, uint32_t* out, std::size_t n) {
+	for (std::size_t i = 0; i < n; ++i) {
+		out[2 * i]     = uint32_t(raw[i]);
+		out[2 * i + 1] = uint32_t(raw[i] >> 32);
+	}
+}
+
+// Calls func(raw, out, count) for consecutive blocks of values where raw
+// holds count words of type Word (uint32_t or uint64_t).
+template <class Word, class T, class Engine, class Func>
+void fill_blocks(Engine& engine, span<T> values, Func&& func) {
+	constexpr std::size_t words = fill_block * sizeof(uint64_t) / sizeof(Word);
+	alignas(32) uint64_t raw[fill_block];
+	alignas(32) uint32_t half[2 * fill_block];
+	for (std::size_t offset = 0; offset < values.size(); offset += words) {
+		std::size_t count = std::min(words, values.size() - offset);
+		std::size_t needed = (count * sizeof(Word) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+		fill_raw(engine, raw, needed);
+		if (sizeof(Word) == sizeof(uint32_t)) {
+			unpack32(raw, half, needed);
+			func(reinterpret_cast<const Word*>(half), values.data() + offset, count);
+		} else {
+			func(reinterpret_cast<const Word*>(raw), values.data() + offset, count);
+		}
+	}
+}
+
+template <class T, class Engine>
+void fill_uniform_impl(Engine& engine, span<T> values, T a, T b, std::true_type) {
+	typedef typename std::conditional<sizeof(T) <= sizeof(uint32_t), uint32_t, uint64_t>::type word_t;
+	const T range = b - a;
+	fill_blocks<word_t>(engine, values, [&] (const word_t* raw, T* out, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			out[i] = a + range * T(detail::to_unit(raw[i]));
+		}
+	});
+}
+
+// Lemire's multiply-shift with rejection. The vectorizable pass maps every
+// word, the rare rejected words are redrawn afterwards.
+template <class T, class Engine>
+void fill_uniform_impl(Engine& engine, span<T> values, T a, T b, std::false_type) {
+	const int64_t lower = a;
+	const uint32_t range = static_cast<uint32_t>(int64_t(b) - lower);
+	if (int64_t(b) <= lower) {
+		std::fill(values.begin(), values.end(), a);
+		return;
+	}
+	const uint32_t threshold = uint32_t(0u - range) % range;
+	fill_blocks<uint32_t>(engine, values, [&] (const uint32_t* raw, T* out, std::size_t count) {
+		uint32_t rejected = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			uint64_t m = uint64_t(raw[i]) * range;
+			out[i] = static_cast<T>(lower + int64_t(m >> 32));
+			rejected |= uint32_t(uint32_t(m) < threshold);
+		}
+		if (!rejected) return;
+		for (std::size_t i = 0; i < count; ++i) {
+			uint64_t m = uint64_t(raw[i]) * range;
+			while (uint32_t(m) < threshold) {
+				m = uint64_t(uint32_t(engine() >> 32)) * range;
+			}
+			out[i] = static_cast<T>(lower + int64_t(m >> 32));
+		}
+	});
+}
+
+} // anonymous
+
+template <class T>
+void rng::fill_uniform(span<T> values, T a, T b) {
+	fill_uniform(bulk_engine(), values, a, b);
+}
+
+template <class T, class Engine>
+void rng::fill_uniform(Engine& engine, span<T> values, T a, T b) {
+	fill_uniform_impl(engine, values, a, b, std::is_floating_point<T>());
+}
+
+template <class T>
+void rng::fill_uniform_01(span<T> values) {
+	fill_uniform_01(bulk_engine(), values);
+}
+
+template <class T, class Engine>
+void rng::fill_uniform_01(Engine& engine, span<T> values) {
+	fill_uniform_impl(engine, values, T(0), T(1), std::true_type());
+}
+
+template <class T>
+void rng::fill_normal(span<T> values, T mean, T std_dev) {
+	fill_normal(bulk_engine(), values, mean, std_dev);
+}
+
+// Ziggurat with one draw per value: the first pass takes the layer
+// rectangles (about 98.5% of all values) branch-free and records the
+// misses, which ziggurat_normal_slow then completes from the same draw.
+template <class T, class Engine>
+void rng::fill_normal(Engine& engine, span<T> values, T mean, T std_dev) {
+	const detail::ziggurat& z = detail::ziggurat::normal();
+	fill_blocks<uint64_t>(engine, values, [&] (const uint64_t* raw, T* out, std::size_t count) {
+		uint32_t missed[fill_block];
+		std::size_t misses = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			unsigned int layer = raw[i] & 255;
+			double x = detail::ziggurat_position(raw[i]) * z.x[layer];
+			missed[misses] = uint32_t(i);
+			misses += x >= z.x[layer + 1];
+			out[i] = mean + std_dev * T(detail::ziggurat_sign(raw[i]) * x);
+		}
+		for (std::size_t m = 0; m < misses; ++m) {
+			out[missed[m]] = mean + std_dev * T(detail::ziggurat_normal_slow(z, engine, raw[missed[m]]));
+		}
+	});
+}
+
+template <class T>
+void rng::fill_exponential(span<T> values, T lambda) {
+	fill_exponential(bulk_engine(), values, lambda);
+}
+
+template <class T, class Engine>
+void rng::fill_exponential(Engine& engine, span<T> values, T lambda) {
+	const detail::ziggurat& z = detail::ziggurat::exponential();
+	const double scale = 1.0 / double(lambda);
+	fill_blocks<uint64_t>(engine, values, [&] (const uint64_t* raw, T* out, std::size_t count) {
+		uint32_t missed[fill_block];
+		std::size_t misses = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			unsigned int layer = raw[i] & 255;
+			double x = detail::ziggurat_position(raw[i]) * z.x[layer];
+			missed[misses] = uint32_t(i);
+			misses += x >= z.x[layer + 1];
+			out[i] = T(scale * x);
+		}
+		for (std::size_t m = 0; m < misses; ++m) {
+			out[missed[m]] = T(scale * detail::ziggurat_exponential_slow(z, engine, raw[missed[m]]));
+		}
+	});
+}
+
+template <class T>
+void rng::fill_geometric(span<T> values, float p) {
+	fill_geometric(bulk_engine(), values, p);
+}
+
+// Inversion: floor(log(u) / log(1 - p)) for u in (0, 1], saturated at the
+// largest value of T.
+template <class T, class Engine>
+void rng::fill_geometric(Engine& engine, span<T> values, float p) {
+	const double scale = 1.0 / std::log1p(-double(p));
+	const double max = double(std::numeric_limits<T>::max());
+	fill_blocks<uint64_t>(engine, values, [&] (const uint64_t* raw, T* out, std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			double k = std::floor(std::log(1.0 - detail::to_unit(raw[i])) * scale);
+			out[i] = static_cast<T>(std::min(k, max));
+		}
+	});
+}
+
+// Vose's O(n) construction: columns below the mean weight are topped up
+// from columns above it, which then rejoin the small or large list.
+template <class T>
+rng::alias_table<T>::alias_table(span<const T> weights) {
+	if (weights.empty()) {
+		throw std::runtime_error("alias_table: Empty weights.");
+	}
+	if (weights.size() > std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("alias_table: More than 2^32 weights.");
+	}
+	double sum = 0.0;
+	for (T w : weights) {
+		if (!(w >= T(0)) || !std::isfinite(w)) {
+			throw std::runtime_error("alias_table: Negative or non-finite weight.");
+		}
+		sum += double(w);
+	}
+	if (!(sum > 0.0) || !std::isfinite(sum)) {
+		throw std::runtime_error("alias_table: Weights must have a positive, finite sum.");
+	}
+
+	const std::size_t n = weights.size();
+	std::vector<double> scaled(n);
+	std::vector<uint32_t> small, large;
+	for (std::size_t i = 0; i < n; ++i) {
+		scaled[i] = double(weights[i]) * double(n) / sum;
+		(scaled[i] < 1.0 ? small : large).push_back(uint32_t(i));
+	}
+
+	table_.resize(n);
+	while (!small.empty() && !large.empty()) {
+		uint32_t s = small.back(); small.pop_back();
+		uint32_t l = large.back();
+		table_[s].threshold = T(scaled[s]);
+		table_[s].alias = l;
+		scaled[l] -= 1.0 - scaled[s];
+		if (scaled[l] < 1.0) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// whatever remains is 1 up to rounding
+	for (uint32_t i : large) table_[i] = entry{T(1), i};
+	for (uint32_t i : small) table_[i] = entry{T(1), i};
+}
+
+template <class T>
+void rng::alias_table<T>::draw(span<uint32_t> out, uint64_t seed, unsigned int threads) const {
+	parallel_streams(out.size(), 65536, seed, [&] (stream_generator_t& engine, std::size_t begin, std::size_t end) {
+		alignas(32) uint64_t raw[fill_block];
+		const uint64_t n = table_.size();
+		for (std::size_t offset = begin; offset < end; offset += fill_block) {
+			std::size_t count = std::min(fill_block, end - offset);
+			fill_raw(engine, raw, count);
+			for (std::size_t i = 0; i < count; ++i) {
+				uint64_t low;
+				const uint64_t column_index = detail::multiply_high(raw[i], n, low);
+				const entry& column = table_[column_index];
+				out[offset + i] = detail::to_unit(low) < double(column.threshold) ? uint32_t(column_index) : column.alias;
+			}
+		}
+	}, threads);
 }
 
 rng::internal_generator_t rng::generator(bool deterministic) {
 	internal_generator_t gen;
 	if (!deterministic) {
-		unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
-		gen.seed(seed);
+		// seeding from the thread's engine keeps generators created within
+		// the same clock tick uncorrelated
+		internal_generator_t& source = engine();
+		std::seed_seq seq{source(), source(), source(), source()};
+		gen.seed(seq);
 	}
 	return gen;
 }
@@ -86,14 +551,20 @@ rng::internal_generator_t rng::generator(bool deterministic) {
 // instantiate for numeric types
 #define X(type) \
 	template type rng::uniform_ab<type>(type a, type b); \
-	template typename rng::traits_t<type>::generator_t rng::uniform_ab_gen<type>(type a, type b, bool deterministic);
+	template typename rng::traits_t<type>::generator_t rng::uniform_ab_gen<type>(type a, type b, bool deterministic); \
+	template void rng::fill_uniform<type>(span<type> values, type a, type b); \
+	template void rng::fill_uniform<type>(bulk_generator_t& engine, span<type> values, type a, type b); \
+	template void rng::fill_uniform<type>(stream_generator_t& engine, span<type> values, type a, type b);
 COMMON_NUMERIC_TYPES
 #undef X
 
 // instantiate for integral types
 #define X(type) \
 	template type rng::geometric<type>(float p); \
-	template typename rng::traits_t<type>::generator_t rng::geometric_gen<type>(float p, bool deterministic);
+	template typename rng::traits_t<type>::generator_t rng::geometric_gen<type>(float p, bool deterministic); \
+	template void rng::fill_geometric<type>(span<type> values, float p); \
+	template void rng::fill_geometric<type>(bulk_generator_t& engine, span<type> values, float p); \
+	template void rng::fill_geometric<type>(stream_generator_t& engine, span<type> values, float p);
 INTEGRAL_NUMERIC_TYPES
 #undef X
 
@@ -101,10 +572,24 @@ INTEGRAL_NUMERIC_TYPES
 #define X(type) \
 	template type rng::uniform_01<type>(); \
 	template type rng::normal<type>(type mean, type std_dev); \
+	template type rng::exponential<type>(type lambda); \
 	template typename rng::traits_t<type>::generator_t rng::uniform_01_gen<type>(bool deterministic); \
-	template typename rng::traits_t<type>::generator_t rng::normal_gen<type>(type mean, type std_dev, bool deterministic);
+	template typename rng::traits_t<type>::generator_t rng::normal_gen<type>(type mean, type std_dev, bool deterministic); \
+	template typename rng::traits_t<type>::generator_t rng::exponential_gen<type>(type lambda, bool deterministic); \
+	template void rng::fill_uniform_01<type>(span<type> values); \
+	template void rng::fill_uniform_01<type>(bulk_generator_t& engine, span<type> values); \
+	template void rng::fill_uniform_01<type>(stream_generator_t& engine, span<type> values); \
+	template void rng::fill_normal<type>(span<type> values, type mean, type std_dev); \
+	template void rng::fill_normal<type>(bulk_generator_t& engine, span<type> values, type mean, type std_dev); \
+	template void rng::fill_normal<type>(stream_generator_t& engine, span<type> values, type mean, type std_dev); \
+	template void rng::fill_exponential<type>(span<type> values, type lambda); \
+	template void rng::fill_exponential<type>(bulk_generator_t& engine, span<type> values, type lambda); \
+	template void rng::fill_exponential<type>(stream_generator_t& engine, span<type> values, type lambda);
 REAL_NUMERIC_TYPES
 #undef X
 
+template class rng::alias_table<float>;
+template class rng::alias_table<double>;
+
 
 } // damogran